@@ -10,49 +10,1371 @@
 *
 */
 
+#define _GNU_SOURCE	//fallocate
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "disk.h"
 
-#define DISK_SEEKDELAY 10
+//A CRC32C usa a instrucao da extensao SSE4.2 quando o processador a oferece
+#if defined(__x86_64__) && defined(__GNUC__)
+#   include <nmmintrin.h>
+#   define DISK_CRCSSE42
+#endif
+
+#define DISK_SEEKDELAY 10		//Atraso por cilindro deslocado (ms)
+#define DISK_SECTORTRANSFERTIME 100	//Tempo de transferencia por setor (us)
+#define DISK_ROTSETTLETIME 800		//Acomodacao da cabeca (us), modelo rotacional
+#define DISK_ROTSHORTCOEF 300		//Coeficiente da raiz da distancia (us)
+#define DISK_ROTSHORTLIMIT 256		//Maior deslocamento curto (cilindros)
+#define DISK_ROTLONGCOEF 10		//Custo por cilindro alem do limite (us)
+#define DISK_ROTATIONTIME 8333		//Periodo de rotacao a 7200 rpm (us)
+#define DISK_PRIOAGELIMIT 1000000	//Limite de espera padrao na fila (us)
+#define DISK_PRIOBGSLICE DISK_SECTORSPERTRACK //Setores de segundo plano por
+					//lote da E/S assincrona
+#define DISK_DEFAULTCACHESECTORS 128	//Capacidade inicial da cache (setores)
+#define DISK_TRACKSEGMENTS 4		//Trilhas no buffer de trilha
 
 #define DISK_SECTORSPERTRACK 64
 #define DISK_SECTORDATAOFFSET 3
 #define DISK_SECTORTOTALSIZE (2*DISK_SECTORDATAOFFSET+DISK_SECTORDATASIZE)
+#define DISK_CYLINDERSIZE (DISK_SECTORSPERTRACK*DISK_SECTORTOTALSIZE)
+
+//Implementacoes de Disk
+#define DISK_KINDFILE 0		//Disco fisico sobre arquivo regular
+#define DISK_KINDSTRIPE 1	//Volume distribuido (RAID-0) sobre membros
+#define DISK_KINDMEMORY 2	//Disco fisico em memoria do processo
+#define DISK_KINDOVERLAY 3	//Sobreposicao com copia na escrita (base e
+				//delta como membros)
+#define DISK_KINDMIRROR 4	//Volume espelhado (RAID-1) sobre membros
+
+//Formato alinhado (DISK_FORMATALIGNED): cabecalho de uma pagina com a
+//assinatura e o numero de setores (8 bytes, little-endian), seguido dos
+//dados dos setores, contiguos e sem enquadramento
+#define DISK_ALIGNEDMAGIC "DSKALGN1"
+#define DISK_ALIGNEDHEADERSIZE 4096
+
+//Formato do arquivo de rastreamento de E/S: cabecalho com a assinatura e o
+//numero de setores do disco, seguido de um registro por operacao. Todos os
+//campos sao gravados em little-endian
+#define DISK_TRACEMAGIC "DSKTRC01"
+#define DISK_TRACEHEADERSIZE 16	//Assinatura (8) e numero de setores (8)
+#define DISK_TRACERECORDSIZE 24	//Instante em us (8), endereco LBA (8),
+				//cilindro (4) e contagem de setores (4),
+				//cujo bit mais alto indica escrita
 
 #define DISK_SECTORPREAMBLE " [["
-#define DISK_SECTORECC "]] "
+#define DISK_SECTORECC "]] "	//ECC de setor sem soma de verificacao
+#define DISK_CRCPOLY 0x82F63B78U	//Polinomio CRC32C (Castagnoli), refletido
+
+//Entrada da cache de setores de um disco. As entradas ficam num vetor e sao
+//encadeadas por indice na lista LRU (prev/next), na lista de livres (next)
+//e na tabela de espalhamento (hnext)
+typedef struct {
+	unsigned long addr;		//Endereco LBA do setor
+	int dirty;			//Se nao nulo, ainda nao gravado no disco
+	int busy;			//Leitura do meio em andamento: 1, ou 2
+					//se o setor foi gravado nesse meio tempo
+	int prev, next;			//Vizinhos na lista LRU
+	int hnext;			//Proxima entrada na mesma posicao
+	unsigned char data[DISK_SECTORDATASIZE]; //Dados do setor
+} DiskCacheEntry;
+
+//Segmento do buffer de trilha: setores de first ate end (exclusive) de uma
+//mesma trilha, lidos antecipadamente
+typedef struct {
+	unsigned long first;		//Primeiro setor presente
+	unsigned long end;		//Setor seguinte ao ultimo (vazio: first)
+	unsigned long stamp;		//Ultimo uso, para substituicao LRU
+	unsigned char data[DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE];
+} DiskTrackSegment;
 
 //Estrutura para a representação de um disco fisico.
 //Seus membros etao protegidos, portanto use o tipo Disk e as funcoes externalizadas por disk.h.
+//A posicao da cabeca e' protegida por headLock; a fila de requisicoes e suas
+//estatisticas, por queueLock; a cache de setores, por cacheLock. As
+//transferencias usam E/S posicional e nao dependem de posicao compartilhada
+//no arquivo, podendo ocorrer em paralelo. Com a cache ligada, as leituras do
+//meio sao feitas sem cacheLock: a entrada de um setor ausente fica ocupada
+//(busy) ate ser preenchida, e quem precisa dela aguarda cacheLoaded.
 struct disk {
 	int id;				//Identificador do disco no sistema
-	FILE* fp;			//Arquivo que implementa o disco
+	int kind;			//Implementacao: DISK_KIND*
+	int fd;				//Arquivo que implementa o disco ou -1
+					//(DISK_KINDMEMORY e volumes virtuais)
+	int format;			//Formato do arquivo: DISK_FORMAT*
+	Disk **members;			//Discos membros de um volume virtual
+	unsigned int numMembers;	//Numero de membros
+	unsigned long stripeUnit;	//Setores por faixa (DISK_KINDSTRIPE)
+	unsigned int mirrorNext;	//Primeiro membro nos empates de leitura
+					//(DISK_KINDMIRROR)
 	unsigned long numCylinders;	//Numero de cilindros
 	unsigned long numSectors;	//Numero de setores
 	unsigned long size;		//Espaco util total para dados no disco
 	unsigned long currCylinder;	//Cilindro atual 
+	int realTime;			//Se nao nulo, deslocamentos dormem
+	int verify;			//Se nao nulo, leituras verificam a CRC
+	unsigned long simTime;		//Tempo simulado acumulado (us)
+	DiskLatencyModel model;		//Modelo de latencia do relogio simulado
+	DiskStats stats;		//Estatisticas de uso
+	unsigned long *heat;		//Setores acessados por cilindro
+	pthread_mutex_t headLock;	//Protege currCylinder, relogio e
+					//estatisticas
+	DiskRequest **queue;		//Fila de requisicoes pendentes
+	unsigned int queueLen;		//Numero de requisicoes na fila
+	unsigned int queueCap;		//Capacidade alocada da fila
+	unsigned long seekFCFS;		//Cilindros percorridos se em ordem de chegada
+	unsigned long seekSched;	//Cilindros percorridos pelo escalonador
+	int sched;			//Escalonador da fila: DISK_SCHED*
+	unsigned long prioAgeLimit;	//Espera maxima antes da promocao (us)
+	pthread_mutex_t queueLock;	//Protege a fila e seus contadores
+	DiskRequest **asyncSQ;		//Anel de submissao ou NULL (sem E/S
+					//assincrona)
+	DiskRequest **asyncCQ;		//Anel de conclusao
+	DiskRequest **asyncBatch;	//Lote em atendimento pelo trabalhador
+	unsigned int asyncDepth;	//Capacidade de cada anel
+	unsigned int sqHead, sqLen;	//Inicio e ocupacao do anel de submissao
+	unsigned int cqHead, cqLen;	//Inicio e ocupacao do anel de conclusao
+	unsigned int asyncInFlight;	//Submetidas e ainda nao colhidas
+	int asyncStop;			//Se nao nulo, o trabalhador deve parar
+	pthread_t asyncWorker;		//Thread que atende o anel de submissao
+	pthread_mutex_t asyncLock;	//Protege os aneis e seus contadores
+	pthread_cond_t asyncSubmitted;	//Sinaliza submissoes ou parada
+	pthread_cond_t asyncCompleted;	//Sinaliza conclusoes
+	unsigned char *map;		//Arquivo mapeado (DISK_MODEMMAP), quadros
+					//em memoria (DISK_KINDMEMORY) ou NULL
+	size_t mapSize;			//Tamanho do mapeamento em bytes
+	DiskCacheEntry *cache;		//Entradas da cache de setores
+	int *cacheHash;			//Tabela de espalhamento por endereco
+	unsigned int cacheCap;		//Capacidade da cache em setores (0: sem)
+	unsigned int cacheBuckets;	//Numero de posicoes em cacheHash
+	int cacheHead, cacheTail;	//Entradas mais e menos recentes (LRU)
+	int cacheFree;			//Lista de entradas livres
+	unsigned long cacheHits;	//Setores atendidos pela cache
+	unsigned long cacheMisses;	//Setores nao encontrados na cache
+	unsigned int cacheLoading;	//Entradas ocupadas por leituras do meio
+	pthread_mutex_t cacheLock;	//Protege a cache e seus contadores
+	pthread_cond_t cacheLoaded;	//Sinaliza o fim dessas leituras
+	DiskTrackSegment *track;	//Buffer de trilha ou NULL (desligado)
+	unsigned long trackClock;	//Contador de usos do buffer de trilha
+	pthread_mutex_t trackLock;	//Protege o buffer de trilha
+	FILE *trace;			//Rastreamento de E/S ou NULL
+	struct timespec traceStart;	//Inicio do rastreamento
+	pthread_mutex_t traceLock;	//Protege o rastreamento
 };
 
+//Entrada interna da fila, usada na ordenacao pelo escalonador
+typedef struct {
+	int wrap;		//1 se o cilindro esta' atras da cabeca
+	int prio;		//Classe efetiva, apos promocao por espera
+	unsigned long addr;	//Endereco LBA do setor
+	unsigned int seq;	//Ordem de chegada, para ordenacao estavel
+	DiskRequest *req;	//Requisicao original
+} DiskQueueEntry;
+
+
+//Funcao interna que retorna a raiz quadrada inteira (truncada) de v
+unsigned long __diskISqrt(unsigned long v) {
+	unsigned long r = 0, bit = 1UL << (sizeof (unsigned long) * 8 - 2);
+	while (bit > v) bit >>= 2;
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		}
+		else r >>= 1;
+		bit >>= 2;
+	}
+	return r;
+}
+
+//Funcao interna que retorna o tempo (us) de deslocamento da cabeca por dist
+//cilindros segundo o modelo m
+unsigned long __diskSeekTime(const DiskLatencyModel *m, unsigned long dist) {
+	unsigned long t;
+	if (!dist) return 0;
+	if (m->seekCurve) return m->seekCurve (m, dist);
+	if (dist <= m->seekShortLimit)
+		return m->settleTime + m->seekShortCoef * __diskISqrt (dist);
+	t = m->settleTime + m->seekShortCoef * __diskISqrt (m->seekShortLimit);
+	return t + m->seekLongCoef * (dist - m->seekShortLimit);
+}
+
+//Funcao interna que retorna o tempo (us) de transferencia de um setor
+//segundo o modelo m
+unsigned long __diskTransferTime(const DiskLatencyModel *m) {
+	if (m->transferTime) return m->transferTime;
+	return m->rotationTime / DISK_SECTORSPERTRACK;
+}
+
+//Funcao interna que retorna o tempo (us) de posicionamento da cabeca, no
+//cilindro fromCyl no instante now do relogio simulado, sobre o inicio do
+//setor addr: deslocamento ate o cilindro e espera rotacional ate o setor. O
+//periodo de rotacao e' arredondado para um numero inteiro de us por setor,
+//de modo que setores consecutivos nao esperem uma volta por arredondamento
+unsigned long __diskPositionTime(const DiskLatencyModel *m,
+                                 unsigned long fromCyl, unsigned long now,
+                                 unsigned long addr) {
+	unsigned long cyl = addr / DISK_SECTORSPERTRACK;
+	unsigned long slot = m->rotationTime / DISK_SECTORSPERTRACK;
+	unsigned long period = slot * DISK_SECTORSPERTRACK;
+	unsigned long t, angle, target;
+	t = __diskSeekTime (m, cyl < fromCyl ? fromCyl - cyl : cyl - fromCyl);
+	if (!period) return t;
+	angle = (now + t) % period;
+	target = (addr % DISK_SECTORSPERTRACK) * slot;
+	return t + (target + period - angle) % period;
+}
+
+//Funcao interna que retorna o numero de entradas do mapa de calor de um
+//disco: seus cilindros completos e, se houver, o cilindro final parcial
+unsigned long __diskHeatSize(Disk *d) {
+	return (d->numSectors + DISK_SECTORSPERTRACK - 1) / DISK_SECTORSPERTRACK;
+}
 
-//Funcao interna, privada, para realizar o posicionamento
-//da cabeca sobre o setor desejado para leitura ou escrita
-//Insere um atraso a cada cilindro deslocado no percurso
-void __diskSeek(Disk *d, unsigned long addr) {
-	unsigned long reqCyl, cylOffset;
-	unsigned long sectorPos = addr * DISK_SECTORTOTALSIZE;
-	unsigned long dataPos = sectorPos + DISK_SECTORDATAOFFSET;
+//Funcao interna, privada, que desloca a cabeca ate o cilindro do setor addr
+//e contabiliza no relogio simulado, segundo o modelo de latencia do disco,
+//o posicionamento e a transferencia de count setores contiguos, terminando
+//sobre o cilindro do ultimo deles. Cada troca de cilindro durante a
+//transferencia custa um deslocamento de um cilindro. Tambem atualiza as
+//estatisticas de uso conforme a operacao (op). Em tempo real, insere um
+//atraso igual ao tempo de posicionamento. A cabeca fica reservada durante
+//todo o deslocamento
+void __diskAccess(Disk *d, unsigned long addr, unsigned long count, int op) {
+	unsigned long reqCyl, lastCyl, seekDist, cylOffset, delay;
+	int bucket = 0;
 
  	diskAddrToCylinder (d, addr, &reqCyl);
-	cylOffset = (reqCyl < d->currCylinder 
-                     ? d->currCylinder - reqCyl
-		     : reqCyl - d->currCylinder);
+ 	diskAddrToCylinder (d, addr + count - 1, &lastCyl);
+	pthread_mutex_lock (&d->headLock);
+	seekDist = (reqCyl < d->currCylinder 
+                    ? d->currCylinder - reqCyl
+		    : reqCyl - d->currCylinder);
+	//A transferencia atravessa os cilindros ate o ultimo setor
+	cylOffset = seekDist + lastCyl - reqCyl;
+
+	delay = __diskPositionTime (&d->model, d->currCylinder, d->simTime, addr)
+	        + (lastCyl - reqCyl) * __diskSeekTime (&d->model, 1);
+	if (d->realTime) {
+		unsigned long msecs = delay / 1000;
+		SLEEP (msecs);
+	}
+
+	d->simTime += delay + count * __diskTransferTime (&d->model);
+	d->currCylinder = lastCyl;
+
+	//Estatisticas de uso
+	if (op == DISK_OPWRITE) d->stats.sectorsWritten += count;
+	else d->stats.sectorsRead += count;
+	if (seekDist) d->stats.numSeeks++;
+	d->stats.cylindersTraversed += cylOffset;
+	while (seekDist && bucket < DISK_SEEKHISTBUCKETS - 1) {
+		seekDist >>= 1;
+		bucket++;
+	}
+	d->stats.seekHist[bucket]++;
+	for (unsigned long c = reqCyl; c <= lastCyl; c++) {
+		unsigned long first = (c == reqCyl ? addr 
+		                       : c * DISK_SECTORSPERTRACK);
+		unsigned long last = (c == lastCyl ? addr + count - 1
+		                      : (c + 1) * DISK_SECTORSPERTRACK - 1);
+		d->heat[c] += last - first + 1;
+	}
+	pthread_mutex_unlock (&d->headLock);
+}
+
+//Funcao interna que retorna a posicao, no arquivo do disco, do quadro
+//(preambulo, dados e ECC) do setor addr
+off_t __diskFramePos(unsigned long addr) {
+	return (off_t) addr * DISK_SECTORTOTALSIZE;
+}
+
+//Funcao interna que retorna a posicao, no arquivo de um disco no formato
+//alinhado, dos dados do setor addr
+off_t __diskAlignedPos(unsigned long addr) {
+	return (off_t) DISK_ALIGNEDHEADERSIZE + addr * DISK_SECTORDATASIZE;
+}
+
+//Tabelas da implementacao portavel da CRC32C, que processa oito bytes por
+//vez (slicing-by-8), e indicacao de suporte do processador a SSE4.2,
+//preenchidas uma unica vez por __diskCRCInit
+unsigned int __diskCRCTable[8][256];
+int __diskCRCHardware = 0;
+pthread_once_t __diskCRCOnce = PTHREAD_ONCE_INIT;
+
+//Funcao interna que prepara o calculo da CRC32C
+void __diskCRCInit(void) {
+	for (unsigned int i = 0; i < 256; i++) {
+		unsigned int c = i;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1 ? (c >> 1) ^ DISK_CRCPOLY : c >> 1);
+		__diskCRCTable[0][i] = c;
+	}
+	for (unsigned int i = 0; i < 256; i++)
+		for (int t = 1; t < 8; t++)
+			__diskCRCTable[t][i] = __diskCRCTable[0][
+			        __diskCRCTable[t-1][i] & 0xFF]
+			        ^ (__diskCRCTable[t-1][i] >> 8);
+#ifdef DISK_CRCSSE42
+	__builtin_cpu_init ();
+	__diskCRCHardware = (__builtin_cpu_supports ("sse4.2") != 0);
+#endif
+}
+
+#ifdef DISK_CRCSSE42
+//Funcao interna que calcula a CRC32C de len bytes com a instrucao crc32 da
+//SSE4.2, oito bytes por vez
+__attribute__((target ("sse4.2")))
+unsigned int __diskCRC32CHardware(const unsigned char *data, size_t len) {
+	unsigned long long c = 0xFFFFFFFFU, v;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		memcpy (&v, data + i, 8);
+		c = _mm_crc32_u64 (c, v);
+	}
+	for (; i < len; i++)
+		c = _mm_crc32_u8 ((unsigned int) c, data[i]);
+	return (unsigned int) c ^ 0xFFFFFFFFU;
+}
+#endif
+
+//Funcao interna que calcula a CRC32C de len bytes de data
+unsigned int __diskCRC32C(const unsigned char *data, size_t len) {
+	unsigned int c = 0xFFFFFFFFU;
+	pthread_once (&__diskCRCOnce, __diskCRCInit);
+#ifdef DISK_CRCSSE42
+	if (__diskCRCHardware) return __diskCRC32CHardware (data, len);
+#endif
+	for (; len >= 8; len -= 8, data += 8) {
+		unsigned int lo = c ^ (data[0] | data[1] << 8 | data[2] << 16
+		                       | (unsigned int) data[3] << 24);
+		c = __diskCRCTable[7][lo & 0xFF]
+		    ^ __diskCRCTable[6][(lo >> 8) & 0xFF]
+		    ^ __diskCRCTable[5][(lo >> 16) & 0xFF]
+		    ^ __diskCRCTable[4][lo >> 24]
+		    ^ __diskCRCTable[3][data[4]] ^ __diskCRCTable[2][data[5]]
+		    ^ __diskCRCTable[1][data[6]] ^ __diskCRCTable[0][data[7]];
+	}
+	for (; len > 0; len--, data++)
+		c = __diskCRCTable[0][(c ^ *data) & 0xFF] ^ (c >> 8);
+	return c ^ 0xFFFFFFFFU;
+}
+
+//Funcao interna que verifica se um quadro de setor nunca foi gravado
+int __diskFrameIsHole(const unsigned char *frame) {
+	return (frame[0] == 0 && frame[1] == 0 && frame[2] == 0);
+}
+
+//Funcao interna que verifica se os dados de um setor estao em branco
+int __diskIsBlank(const unsigned char *data) {
+	for (int i = 0; i < DISK_SECTORDATASIZE; i++)
+		if (data[i] != ' ') return 0;
+	return 1;
+}
+
+//Funcao interna que retorna o valor de 24 bits gravado no campo ECC de um
+//setor com os dados data: os bits menos significativos de sua CRC32C. Se
+//coincidirem com o ECC constante de formatos anteriores (DISK_SECTORECC), o
+//bit menos significativo e' invertido, para que o setor nao seja tomado por
+//um setor sem soma
+unsigned int __diskFrameECC(const unsigned char *data) {
+	unsigned int legacy = (unsigned char) DISK_SECTORECC[0]
+	                      | (unsigned char) DISK_SECTORECC[1] << 8
+	                      | (unsigned char) DISK_SECTORECC[2] << 16;
+	unsigned int ecc = __diskCRC32C (data, DISK_SECTORDATASIZE) & 0xFFFFFF;
+	return (ecc == legacy ? ecc ^ 1 : ecc);
+}
+
+//Funcao interna que verifica a soma do quadro de setor frame, cujo campo
+//ECC e' calculado por __diskFrameECC. Quadros nunca gravados e quadros com o
+//ECC constante de formatos anteriores (DISK_SECTORECC) nao tem soma. Retorna
+//0 se o quadro estiver integro ou sem soma e -1 caso contrario
+int __diskFrameCheck(const unsigned char *frame) {
+	const unsigned char *ecc = frame + DISK_SECTORDATAOFFSET 
+	                           + DISK_SECTORDATASIZE;
+	unsigned int stored;
+	if (__diskFrameIsHole (frame)) return 0;
+	if (memcmp (ecc, DISK_SECTORECC, DISK_SECTORDATAOFFSET) == 0) return 0;
+	stored = (unsigned int) (ecc[0] | ecc[1] << 8 | ecc[2] << 16);
+	return (stored == __diskFrameECC (frame + DISK_SECTORDATAOFFSET)
+	        ? 0 : -1);
+}
 
-	for (unsigned long i=1; i <= cylOffset; i++)
-		SLEEP (DISK_SEEKDELAY);
+//Funcao interna que copia para data os dados do quadro de setor frame do
+//disco d. Um quadro nunca gravado, lido como zeros de um buraco do arquivo
+//do disco (disco esparso ou setores descartados), contem um setor em branco.
+//Com a verificacao ligada, um quadro com soma incorreta e' contado nas
+//estatisticas. Retorna 0 se bem sucedido e -1 se a soma nao conferir
+int __diskFrameGet(Disk *d, const unsigned char *frame, unsigned char *data) {
+	if (d->verify && __diskFrameCheck (frame) < 0) {
+		pthread_mutex_lock (&d->headLock);
+		d->stats.checksumErrors++;
+		pthread_mutex_unlock (&d->headLock);
+		return -1;
+	}
+	if (__diskFrameIsHole (frame))
+		memset (data, ' ', DISK_SECTORDATASIZE);
+	else
+		memcpy (data, frame + DISK_SECTORDATAOFFSET,
+		        DISK_SECTORDATASIZE);
+	return 0;
+}
+
+//Funcao interna que monta em frame o quadro completo de um setor com os
+//dados de data e sua soma de verificacao
+void __diskFramePut(unsigned char *frame, const unsigned char *data) {
+	unsigned char *ecc = frame + DISK_SECTORDATAOFFSET 
+	                     + DISK_SECTORDATASIZE;
+	unsigned int crc = __diskFrameECC (data);
+	memcpy (frame, DISK_SECTORPREAMBLE, DISK_SECTORDATAOFFSET);
+	memcpy (frame + DISK_SECTORDATAOFFSET, data, DISK_SECTORDATASIZE);
+	ecc[0] = crc & 0xFF;
+	ecc[1] = (crc >> 8) & 0xFF;
+	ecc[2] = (crc >> 16) & 0xFF;
+}
+
+//Funcao interna que le exatamente len bytes do arquivo fd a partir da
+//posicao pos, repetindo leituras parciais. Retorna 0 ou -1 em caso de falha
+int __diskPread(int fd, unsigned char *buf, size_t len, off_t pos) {
+	while (len > 0) {
+		ssize_t n = pread (fd, buf, len, pos);
+		if (n <= 0) return -1;
+		buf += n; pos += n; len -= n;
+	}
+	return 0;
+}
+
+//Funcao interna que grava exatamente len bytes no arquivo fd a partir da
+//posicao pos, repetindo escritas parciais. Retorna 0 ou -1 em caso de falha
+int __diskPwrite(int fd, const unsigned char *buf, size_t len, off_t pos) {
+	while (len > 0) {
+		ssize_t n = pwrite (fd, buf, len, pos);
+		if (n <= 0) return -1;
+		buf += n; pos += n; len -= n;
+	}
+	return 0;
+}
+
+//Funcao interna que grava em p os bytes menos significativos de v, em
+//little-endian
+void __diskPutLE(unsigned char *p, unsigned long v, int bytes) {
+	for (int i = 0; i < bytes; i++, v >>= 8)
+		p[i] = (unsigned char) (v & 0xFF);
+}
 
-	fseek (d->fp, dataPos, 0);
-	d->currCylinder = reqCyl;
+//Funcao interna que le de p um valor de bytes bytes em little-endian
+unsigned long __diskGetLE(unsigned char *p, int bytes) {
+	unsigned long v = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+//Funcao interna que reduz o disco fisico recem-criado do arquivo rawDiskPath,
+//no formato format, a numSectors setores, deixando um cilindro final parcial.
+//No formato alinhado, o numero de setores do cabecalho tambem e' ajustado.
+//Retorna 0 se bem sucedido e -1 caso contrario
+int __diskTrimRawDisk(char *rawDiskPath, int format, unsigned long numSectors) {
+	unsigned char count[8];
+	int fd, result = 0;
+	off_t end = (format == DISK_FORMATALIGNED ? __diskAlignedPos (numSectors)
+	             : __diskFramePos (numSectors));
+	fd = open (rawDiskPath, O_RDWR);
+	if (fd < 0) return -1;
+	if (format == DISK_FORMATALIGNED) {
+		__diskPutLE (count, numSectors, 8);
+		result = __diskPwrite (fd, count, sizeof (count), 8);
+	}
+	if (result == 0 && ftruncate (fd, end) != 0) result = -1;
+	if (close (fd) != 0) result = -1;
+	return result;
+}
+
+//Funcao interna que retorna o endereco, no mapeamento em memoria, do quadro
+//do setor addr
+unsigned char* __diskMapFrame(Disk *d, unsigned long addr) {
+	return d->map + __diskFramePos (addr);
+}
+
+//Funcao interna que contabiliza um acesso a count setores de um volume
+//virtual, cujos membros ja posicionaram suas proprias cabecas. O relogio
+//simulado do volume avanca elapsed us e as estatisticas de setores e o mapa
+//de calor sao atualizados como em __diskAccess. Em tempo real, o volume
+//insere um atraso de elapsed us
+void __diskAccountVirtual(Disk *d, unsigned long addr, unsigned long count,
+                          int op, unsigned long elapsed) {
+	unsigned long firstCyl, lastCyl;
+ 	diskAddrToCylinder (d, addr, &firstCyl);
+ 	diskAddrToCylinder (d, addr + count - 1, &lastCyl);
+	if (diskGetRealTime (d)) SLEEP (elapsed / 1000);
+	pthread_mutex_lock (&d->headLock);
+	d->simTime += elapsed;
+	d->currCylinder = lastCyl;
+	if (op == DISK_OPWRITE) d->stats.sectorsWritten += count;
+	else d->stats.sectorsRead += count;
+	for (unsigned long c = firstCyl; c <= lastCyl; c++) {
+		unsigned long first = (c == firstCyl ? addr 
+		                       : c * DISK_SECTORSPERTRACK);
+		unsigned long last = (c == lastCyl ? addr + count - 1
+		                      : (c + 1) * DISK_SECTORSPERTRACK - 1);
+		d->heat[c] += last - first + 1;
+	}
+	pthread_mutex_unlock (&d->headLock);
+}
+
+//Funcao interna que traduz o setor a de um volume distribuido para o membro
+//*m e o setor *maddr desse membro. Em *len e' escrito quantos setores, a
+//partir de a e ate end (exclusive), seguem contiguos no mesmo membro
+void __diskStripeMap(Disk *d, unsigned long a, unsigned long end,
+                     unsigned int *m, unsigned long *maddr,
+                     unsigned long *len) {
+	unsigned long stripe = a / d->stripeUnit, off = a % d->stripeUnit;
+	*m = stripe % d->numMembers;
+	*maddr = (stripe / d->numMembers) * d->stripeUnit + off;
+	*len = d->stripeUnit - off;
+	if (*len > end - a) *len = end - a;
+}
+
+//Funcao interna que copia os dados de count setores de um volume
+//distribuido entre data e os buffers de cada membro (buf), cujas faixas
+//comecam nos setores lo. Na gravacao (op = DISK_OPWRITE) copia de data para
+//os buffers; na leitura, no sentido inverso
+void __diskStripeCopy(Disk *d, unsigned long addr, unsigned long count,
+                      unsigned char *data, unsigned long *lo,
+                      unsigned char **buf, int op) {
+	for (unsigned long a = addr; a < addr + count; ) {
+		unsigned int m;
+		unsigned long maddr, len;
+		unsigned char *mdata, *vdata;
+		__diskStripeMap (d, a, addr + count, &m, &maddr, &len);
+		mdata = buf[m] + (maddr - lo[m]) * DISK_SECTORDATASIZE;
+		vdata = data + (a - addr) * DISK_SECTORDATASIZE;
+		if (op == DISK_OPWRITE)
+			memcpy (mdata, vdata, len * DISK_SECTORDATASIZE);
+		else
+			memcpy (vdata, mdata, len * DISK_SECTORDATASIZE);
+		a += len;
+	}
+}
+
+//Funcao interna que le (op = DISK_OPREAD) ou grava count setores contiguos
+//de um volume distribuido. Os setores de cada membro formam uma faixa
+//contigua no membro e sao transferidos numa unica operacao por membro. Como
+//as cabecas dos membros sao independentes, o tempo simulado do volume e' o
+//do membro mais lento
+int __diskStripeTransfer(Disk *d, unsigned long addr, unsigned long count,
+                         unsigned char *data, int op) {
+	unsigned int n = d->numMembers;
+	unsigned long elapsed = 0;
+	unsigned long *lo, *hi, *start;
+	unsigned char **buf;
+	int result = 0;
+	lo = calloc (n, sizeof (unsigned long));
+	hi = calloc (n, sizeof (unsigned long));
+	start = malloc (n * sizeof (unsigned long));
+	buf = calloc (n, sizeof (unsigned char*));
+	if (!lo || !hi || !start || !buf) result = -1;
+
+	//Faixa de setores de cada membro coberta pela transferencia
+	for (unsigned long a = addr; a < addr + count && result == 0; ) {
+		unsigned int m;
+		unsigned long maddr, len;
+		__diskStripeMap (d, a, addr + count, &m, &maddr, &len);
+		if (hi[m] == lo[m]) lo[m] = maddr;
+		hi[m] = maddr + len;
+		a += len;
+	}
+	for (unsigned int m = 0; m < n && result == 0; m++) {
+		start[m] = diskGetElapsedSimTime (d->members[m]);
+		if (hi[m] > lo[m]) {
+			buf[m] = malloc ((hi[m] - lo[m]) * DISK_SECTORDATASIZE);
+			if (!buf[m]) result = -1;
+		}
+	}
+
+	if (result == 0 && op == DISK_OPWRITE)
+		__diskStripeCopy (d, addr, count, data, lo, buf, op);
+	for (unsigned int m = 0; m < n && result == 0; m++) {
+		if (hi[m] == lo[m]) continue;
+		if (op == DISK_OPWRITE)
+			result = diskWriteSectors (d->members[m], lo[m],
+			                           hi[m] - lo[m], buf[m]);
+		else
+			result = diskReadSectors (d->members[m], lo[m],
+			                          hi[m] - lo[m], buf[m]);
+	}
+	if (result == 0 && op == DISK_OPREAD)
+		__diskStripeCopy (d, addr, count, data, lo, buf, op);
+
+	if (result == 0) {
+		for (unsigned int m = 0; m < n; m++) {
+			unsigned long t = diskGetElapsedSimTime (d->members[m])
+			                  - start[m];
+			if (t > elapsed) elapsed = t;
+		}
+		__diskAccountVirtual (d, addr, count, op, elapsed);
+	}
+	if (buf)
+		for (unsigned int m = 0; m < n; m++) free (buf[m]);
+	free (buf); free (lo); free (hi); free (start);
+	return result;
+}
+
+//Funcao interna que le (op = DISK_OPREAD) ou grava count setores contiguos
+//de um volume espelhado. A gravacao vai para todos os membros e o tempo
+//simulado do volume e' o do membro mais lento. A leitura e' atendida pelo
+//membro cuja cabeca esta' mais proxima do cilindro do primeiro setor, com
+//empates alternados entre os membros. Se a leitura falhar, os demais membros
+//sao tentados, do mais proximo ao mais distante, e o tempo de todas as
+//tentativas e' contabilizado
+int __diskMirrorTransfer(Disk *d, unsigned long addr, unsigned long count,
+                         unsigned char *data, int op) {
+	unsigned int n = d->numMembers, first;
+	unsigned long cyl = addr / DISK_SECTORSPERTRACK, elapsed = 0;
+	unsigned char *tried;
+	int result = 0;
+
+	if (op == DISK_OPWRITE) {
+		for (unsigned int m = 0; m < n; m++) {
+			unsigned long t, start;
+			start = diskGetElapsedSimTime (d->members[m]);
+			if (diskWriteSectors (d->members[m], addr, count, data) < 0)
+				result = -1;
+			t = diskGetElapsedSimTime (d->members[m]) - start;
+			if (t > elapsed) elapsed = t;
+		}
+		if (result == 0) __diskAccountVirtual (d, addr, count, op, elapsed);
+		return result;
+	}
+
+	tried = calloc (n, 1);
+	if (!tried) return -1;
+	pthread_mutex_lock (&d->headLock);
+	first = d->mirrorNext;
+	d->mirrorNext = (d->mirrorNext + 1) % n;
+	pthread_mutex_unlock (&d->headLock);
+	result = -1;
+	for (unsigned int attempt = 0; attempt < n && result < 0; attempt++) {
+		unsigned int best = n;
+		unsigned long bestDist = 0, start;
+		for (unsigned int k = 0; k < n; k++) {
+			unsigned int m = (first + k) % n;
+			unsigned long c, dist;
+			if (tried[m]) continue;
+			c = diskGetCurrentCylinder (d->members[m]);
+			dist = (c < cyl ? cyl - c : c - cyl);
+			if (best == n || dist < bestDist) {
+				best = m;
+				bestDist = dist;
+			}
+		}
+		tried[best] = 1;
+		start = diskGetElapsedSimTime (d->members[best]);
+		result = diskReadSectors (d->members[best], addr, count, data);
+		elapsed += diskGetElapsedSimTime (d->members[best]) - start;
+	}
+	free (tried);
+	if (result == 0) __diskAccountVirtual (d, addr, count, op, elapsed);
+	return result;
+}
+
+//Funcao interna que le count setores contiguos, ja validados, a partir do
+//setor addr do arquivo de um disco fisico, com um unico posicionamento e uma
+//unica transferencia
+int __diskFileRead(Disk *d, unsigned long addr, unsigned long count,
+                   unsigned char *data) {
+	unsigned char frame[DISK_SECTORTOTALSIZE], *frames = frame;
+	int result = 0;
+
+	__diskAccess (d, addr, count, DISK_OPREAD);
+	if (d->format == DISK_FORMATALIGNED) {
+		//Os setores sao contiguos: uma unica copia
+		if (d->map) {
+			memcpy (data, d->map + __diskAlignedPos (addr),
+			        count * DISK_SECTORDATASIZE);
+			return 0;
+		}
+		return __diskPread (d->fd, data, count * DISK_SECTORDATASIZE,
+		                    __diskAlignedPos (addr));
+	}
+	if (d->map) {
+		for (unsigned long i = 0; i < count; i++)
+			if (__diskFrameGet (d, __diskMapFrame (d, addr + i),
+			                    data + i * DISK_SECTORDATASIZE) < 0)
+				return -1;
+		return 0;
+	}
+	if (count > 1) {
+		frames = malloc (count * DISK_SECTORTOTALSIZE);
+		if (!frames) return -1;
+	}
+	if (__diskPread (d->fd, frames, count * DISK_SECTORTOTALSIZE,
+	                 __diskFramePos (addr)) < 0) {
+		if (frames != frame) free (frames);
+		return -1;
+	}
+	for (unsigned long i = 0; i < count && result == 0; i++)
+		result = __diskFrameGet (d, frames + i * DISK_SECTORTOTALSIZE,
+		                         data + i * DISK_SECTORDATASIZE);
+	if (frames != frame) free (frames);
+	return result;
+}
+
+//Funcao interna que grava count setores contiguos, ja validados, a partir
+//do setor addr do arquivo de um disco fisico, com um unico posicionamento e
+//uma unica transferencia. Os quadros completos (preambulo e ECC) dos setores
+//sao regravados
+int __diskFileWrite(Disk *d, unsigned long addr, unsigned long count,
+                    unsigned char *data) {
+	unsigned char frame[DISK_SECTORTOTALSIZE], *frames = frame;
+
+	__diskAccess (d, addr, count, DISK_OPWRITE);
+	if (d->format == DISK_FORMATALIGNED) {
+		if (d->map) {
+			memcpy (d->map + __diskAlignedPos (addr), data,
+			        count * DISK_SECTORDATASIZE);
+			return 0;
+		}
+		return __diskPwrite (d->fd, data, count * DISK_SECTORDATASIZE,
+		                     __diskAlignedPos (addr));
+	}
+	if (d->map) {
+		for (unsigned long i = 0; i < count; i++)
+			__diskFramePut (__diskMapFrame (d, addr + i),
+			                data + i * DISK_SECTORDATASIZE);
+		return 0;
+	}
+	if (count > 1) {
+		frames = malloc (count * DISK_SECTORTOTALSIZE);
+		if (!frames) return -1;
+	}
+	for (unsigned long i = 0; i < count; i++)
+		__diskFramePut (frames + i * DISK_SECTORTOTALSIZE,
+		                data + i * DISK_SECTORDATASIZE);
+	if (__diskPwrite (d->fd, frames, count * DISK_SECTORTOTALSIZE,
+	                  __diskFramePos (addr)) < 0) {
+		if (frames != frame) free (frames);
+		return -1;
+	}
+	if (frames != frame) free (frames);
+	return 0;
+}
+
+//Funcao interna que invalida os segmentos do buffer de trilha de um disco
+//que contenham algum dos count setores a partir de addr. Deve ser chamada
+//com trackLock
+void __diskTrackInvalidate(Disk *d, unsigned long addr, unsigned long count) {
+	if (!d->track) return;
+	for (int i = 0; i < DISK_TRACKSEGMENTS; i++) {
+		DiskTrackSegment *t = &d->track[i];
+		if (addr < t->end && addr + count > t->first)
+			t->first = t->end = 0;
+	}
+}
+
+//Funcao interna que le count setores contiguos de uma mesma trilha pelo
+//buffer de trilha. Setores ja no buffer sao atendidos da memoria, sem
+//deslocamento da cabeca nem transferencia. Caso contrario, o segmento menos
+//recentemente usado passa a conter os setores de addr ate o fim da trilha,
+//lidos numa unica transferencia. Se a leitura antecipada falhar, apenas os
+//setores pedidos sao lidos. Retorna 0 se bem sucedido e -1 caso contrario
+int __diskTrackRead(Disk *d, unsigned long addr, unsigned long count,
+                    unsigned char *data) {
+	DiskTrackSegment *t = NULL;
+	unsigned long end;
+	int result;
+	pthread_mutex_lock (&d->trackLock);
+	if (!d->track) {
+		pthread_mutex_unlock (&d->trackLock);
+		return __diskFileRead (d, addr, count, data);
+	}
+	for (int i = 0; i < DISK_TRACKSEGMENTS; i++) {
+		DiskTrackSegment *c = &d->track[i];
+		if (addr >= c->first && addr + count <= c->end) {
+			c->stamp = ++d->trackClock;
+			memcpy (data, c->data + (addr - c->first)
+			              * DISK_SECTORDATASIZE,
+			        count * DISK_SECTORDATASIZE);
+			pthread_mutex_unlock (&d->trackLock);
+			pthread_mutex_lock (&d->headLock);
+			d->stats.trackHits += count;
+			pthread_mutex_unlock (&d->headLock);
+			return 0;
+		}
+		if (!t || c->stamp < t->stamp) t = c;
+	}
+	end = (addr / DISK_SECTORSPERTRACK + 1) * DISK_SECTORSPERTRACK;
+	if (end > d->numSectors) end = d->numSectors;
+	//A trilha pode estar parcialmente em outro segmento
+	__diskTrackInvalidate (d, addr, end - addr);
+	t->first = t->end = 0;
+	result = __diskFileRead (d, addr, end - addr, t->data);
+	if (result == 0) {
+		t->first = addr;
+		t->end = end;
+		t->stamp = ++d->trackClock;
+		memcpy (data, t->data, count * DISK_SECTORDATASIZE);
+	}
+	pthread_mutex_unlock (&d->trackLock);
+	if (result < 0)
+		result = __diskFileRead (d, addr, count, data);
+	return result;
+}
+
+//Funcao interna que le ou grava (op) count setores contiguos, ja validados,
+//a partir do setor addr de uma sobreposicao, contabilizando um unico acesso
+//no relogio do volume. Escritas vao para o delta. Na leitura, setores
+//presentes no delta sao lidos dele e as sequencias de setores ausentes
+//(quadros nunca gravados), da base. Retorna 0 se bem sucedido e -1 caso
+//contrario
+int __diskOverlayTransfer(Disk *d, unsigned long addr, unsigned long count,
+                          unsigned char *data, int op) {
+	Disk *base = d->members[0], *delta = d->members[1];
+	unsigned char *frames;
+	int result = 0;
+
+	__diskAccess (d, addr, count, op);
+	if (op == DISK_OPWRITE)
+		return diskWriteSectors (delta, addr, count, data);
+	frames = malloc (count * DISK_SECTORTOTALSIZE);
+	if (!frames) return -1;
+	result = __diskPread (delta->fd, frames, count * DISK_SECTORTOTALSIZE,
+	                      __diskFramePos (addr));
+	for (unsigned long i = 0; i < count && result == 0; ) {
+		unsigned long j = i;
+		while (j < count &&
+		       __diskFrameIsHole (frames + j * DISK_SECTORTOTALSIZE))
+			j++;
+		if (j > i) {
+			result = diskReadSectors (base, addr + i, j - i,
+			                          data + i * DISK_SECTORDATASIZE);
+			i = j;
+			continue;
+		}
+		result = __diskFrameGet (d, frames + i * DISK_SECTORTOTALSIZE,
+		                         data + i * DISK_SECTORDATASIZE);
+		i++;
+	}
+	free (frames);
+	return result;
+}
+
+//Funcao interna que le count setores contiguos, ja validados, a partir do
+//setor addr do meio fisico: dos membros de um volume distribuido, do buffer
+//de trilha, se ligado e se os setores estiverem numa mesma trilha, ou do
+//arquivo do disco. Uma sobreposicao le do delta e da base; um volume
+//espelhado, de um dos membros
+int __diskMediaRead(Disk *d, unsigned long addr, unsigned long count,
+                    unsigned char *data) {
+	if (d->kind == DISK_KINDSTRIPE)
+		return __diskStripeTransfer (d, addr, count, data, DISK_OPREAD);
+	if (d->kind == DISK_KINDOVERLAY)
+		return __diskOverlayTransfer (d, addr, count, data, DISK_OPREAD);
+	if (d->kind == DISK_KINDMIRROR)
+		return __diskMirrorTransfer (d, addr, count, data, DISK_OPREAD);
+	if (d->track && addr / DISK_SECTORSPERTRACK 
+	                == (addr + count - 1) / DISK_SECTORSPERTRACK)
+		return __diskTrackRead (d, addr, count, data);
+	return __diskFileRead (d, addr, count, data);
+}
+
+//Funcao interna que grava count setores contiguos, ja validados, a partir
+//do setor addr no meio fisico, com um unico posicionamento e uma unica
+//transferencia. Setores presentes no buffer de trilha sao atualizados nele
+int __diskMediaWrite(Disk *d, unsigned long addr, unsigned long count,
+                     unsigned char *data) {
+	int result;
+	if (d->kind == DISK_KINDSTRIPE)
+		return __diskStripeTransfer (d, addr, count, data, 
+		                             DISK_OPWRITE);
+	if (d->kind == DISK_KINDOVERLAY)
+		return __diskOverlayTransfer (d, addr, count, data,
+		                              DISK_OPWRITE);
+	if (d->kind == DISK_KINDMIRROR)
+		return __diskMirrorTransfer (d, addr, count, data,
+		                             DISK_OPWRITE);
+	result = __diskFileWrite (d, addr, count, data);
+	if (d->track) {
+		pthread_mutex_lock (&d->trackLock);
+		if (result < 0)
+			__diskTrackInvalidate (d, addr, count);
+		else
+			for (int i = 0; d->track && i < DISK_TRACKSEGMENTS; i++) {
+				DiskTrackSegment *t = &d->track[i];
+				unsigned long lo = (addr > t->first ? addr
+				                    : t->first);
+				unsigned long hi = (addr + count < t->end 
+				                    ? addr + count : t->end);
+				if (lo < hi)
+					memcpy (t->data + (lo - t->first)
+					        * DISK_SECTORDATASIZE,
+					        data + (lo - addr)
+					        * DISK_SECTORDATASIZE,
+					        (hi - lo) * DISK_SECTORDATASIZE);
+			}
+		pthread_mutex_unlock (&d->trackLock);
+	}
+	return result;
+}
+
+//Funcao interna que descarta count setores contiguos, ja validados, a
+//partir do setor addr, que passam a ser lidos como setores em branco. Se o
+//sistema hospedeiro permitir, o trecho correspondente do arquivo do disco e'
+//desalocado (buraco); caso contrario, os quadros sao zerados. No formato
+//alinhado, sem quadros para distinguir buracos, os setores sao regravados em
+//branco, assim como no delta de uma sobreposicao. Nao ha deslocamento da
+//cabeca nem custo no relogio simulado do disco
+int __diskMediaDiscard(Disk *d, unsigned long addr, unsigned long count) {
+	off_t pos = __diskFramePos (addr);
+	size_t len = count * DISK_SECTORTOTALSIZE;
+	unsigned char *zeros, fill = 0;
+	int result = 0;
+
+	if (d->kind == DISK_KINDSTRIPE) {
+		for (unsigned long a = addr; a < addr + count && result == 0; ) {
+			unsigned int m;
+			unsigned long maddr, n;
+			__diskStripeMap (d, a, addr + count, &m, &maddr, &n);
+			result = diskDiscardSectors (d->members[m], maddr, n);
+			a += n;
+		}
+		return result;
+	}
+	if (d->kind == DISK_KINDMIRROR) {
+		for (unsigned int m = 0; m < d->numMembers; m++)
+			if (diskDiscardSectors (d->members[m], addr, count) < 0)
+				result = -1;
+		return result;
+	}
+	//Na sobreposicao, um buraco no delta exporia a base: os setores sao
+	//regravados em branco no delta
+	if (d->kind == DISK_KINDOVERLAY) {
+		zeros = malloc (DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE);
+		if (!zeros) return -1;
+		memset (zeros, ' ', DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE);
+		for (unsigned long a = addr; a < addr + count && result == 0; ) {
+			unsigned long n = addr + count - a;
+			if (n > DISK_SECTORSPERTRACK) n = DISK_SECTORSPERTRACK;
+			result = diskWriteSectors (d->members[1], a, n, zeros);
+			a += n;
+		}
+		free (zeros);
+		return result;
+	}
+
+	if (d->track) {
+		pthread_mutex_lock (&d->trackLock);
+		__diskTrackInvalidate (d, addr, count);
+		pthread_mutex_unlock (&d->trackLock);
+	}
+	if (d->format == DISK_FORMATALIGNED) {
+		pos = __diskAlignedPos (addr);
+		len = count * DISK_SECTORDATASIZE;
+		fill = ' ';
+	}
+#ifdef FALLOC_FL_PUNCH_HOLE
+	else if (d->fd >= 0 &&
+	         fallocate (d->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	                    pos, len) == 0)
+		return 0;
+#endif
+	if (d->map) {
+		memset (d->map + pos, fill, len);
+		return 0;
+	}
+	zeros = malloc (DISK_CYLINDERSIZE);
+	if (!zeros) return -1;
+	memset (zeros, fill, DISK_CYLINDERSIZE);
+	while (len > 0 && result == 0) {
+		size_t n = (len < DISK_CYLINDERSIZE ? len : DISK_CYLINDERSIZE);
+		result = __diskPwrite (d->fd, zeros, n, pos);
+		pos += n;
+		len -= n;
+	}
+	free (zeros);
+	return result;
+}
+
+//Funcao interna que mapeia em memoria o arquivo de um disco. Retorna 0 se
+//bem sucedido ou -1 caso contrario
+int __diskMapFile(Disk *d) {
+	void *map;
+	if (d->numSectors == 0) return -1;
+	if (d->format == DISK_FORMATALIGNED)
+		d->mapSize = __diskAlignedPos (d->numSectors);
+	else
+		d->mapSize = d->numSectors * DISK_SECTORTOTALSIZE;
+	map = mmap (NULL, d->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	            d->fd, 0);
+	if (map == MAP_FAILED) return -1;
+	d->map = map;
+	return 0;
+}
+
+//Funcao interna que desfaz o mapeamento em memoria do arquivo de um disco,
+//persistindo as alteracoes, ou libera os quadros de um disco em memoria.
+//Retorna 0 se bem sucedido ou -1 caso contrario
+int __diskUnmapFile(Disk *d) {
+	int result = 0;
+	if (!d->map) return 0;
+	if (d->fd >= 0 && msync (d->map, d->mapSize, MS_SYNC) != 0) result = -1;
+	if (munmap (d->map, d->mapSize) != 0) result = -1;
+	d->map = NULL;
+	d->mapSize = 0;
+	return result;
+}
+
+//Funcao interna que retorna o indice da entrada da cache que contem o setor
+//addr ou -1 se o setor nao estiver na cache
+int __diskCacheLookup(Disk *d, unsigned long addr) {
+	int e = d->cacheHash[addr % d->cacheBuckets];
+	while (e >= 0 && d->cache[e].addr != addr)
+		e = d->cache[e].hnext;
+	return e;
+}
+
+//Funcao interna que retira uma entrada da lista LRU da cache
+void __diskCacheLRUUnlink(Disk *d, int e) {
+	DiskCacheEntry *c = &d->cache[e];
+	if (c->prev >= 0) d->cache[c->prev].next = c->next;
+	else d->cacheHead = c->next;
+	if (c->next >= 0) d->cache[c->next].prev = c->prev;
+	else d->cacheTail = c->prev;
+}
+
+//Funcao interna que insere uma entrada no inicio (mais recente) da lista LRU
+void __diskCacheLRUPush(Disk *d, int e) {
+	d->cache[e].prev = -1;
+	d->cache[e].next = d->cacheHead;
+	if (d->cacheHead >= 0) d->cache[d->cacheHead].prev = e;
+	d->cacheHead = e;
+	if (d->cacheTail < 0) d->cacheTail = e;
+}
+
+//Funcao interna que marca uma entrada da cache como a mais recentemente usada
+void __diskCacheTouch(Disk *d, int e) {
+	if (d->cacheHead == e) return;
+	__diskCacheLRUUnlink (d, e);
+	__diskCacheLRUPush (d, e);
+}
+
+//Funcao interna que remove uma entrada da cache, sem grava-la, devolvendo-a
+//a lista de entradas livres
+void __diskCacheDrop(Disk *d, int e) {
+	int *link = &d->cacheHash[d->cache[e].addr % d->cacheBuckets];
+	while (*link != e) link = &d->cache[*link].hnext;
+	*link = d->cache[e].hnext;
+	__diskCacheLRUUnlink (d, e);
+	d->cache[e].next = d->cacheFree;
+	d->cacheFree = e;
+}
+
+//Funcao interna que obtem uma entrada da cache para o setor addr, ainda nao
+//presente, descartando a entrada desocupada menos recentemente usada se
+//necessario. Uma entrada suja descartada e' antes gravada no disco. Retorna o
+//indice da entrada ou -1 em caso de falha ou se todas as entradas estiverem
+//ocupadas por leituras do meio
+int __diskCacheAlloc(Disk *d, unsigned long addr) {
+	int e = d->cacheFree;
+	if (e >= 0) d->cacheFree = d->cache[e].next;
+	else {
+		e = d->cacheTail;
+		while (e >= 0 && d->cache[e].busy) e = d->cache[e].prev;
+		if (e < 0) return -1;
+		if (d->cache[e].dirty &&
+		    __diskMediaWrite (d, d->cache[e].addr, 1,
+		                      d->cache[e].data) < 0)
+			return -1;
+		__diskCacheDrop (d, e);
+		d->cacheFree = d->cache[e].next;
+	}
+	d->cache[e].addr = addr;
+	d->cache[e].dirty = 0;
+	d->cache[e].busy = 0;
+	d->cache[e].hnext = d->cacheHash[addr % d->cacheBuckets];
+	d->cacheHash[addr % d->cacheBuckets] = e;
+	__diskCacheLRUPush (d, e);
+	return e;
+}
+
+//Funcao interna que retorna 1 se alguma entrada da cache dos count setores a
+//partir de addr estiver ocupada por uma leitura do meio e 0 caso contrario
+int __diskCacheBusy(Disk *d, unsigned long addr, unsigned long count) {
+	int e;
+	if (!d->cacheLoading) return 0;
+	for (unsigned long i = 0; i < count; i++)
+		if ((e = __diskCacheLookup (d, addr + i)) >= 0 && d->cache[e].busy)
+			return 1;
+	return 0;
+}
+
+//Funcao interna que aguarda o fim de todas as leituras do meio que ocupam
+//entradas da cache. Deve ser chamada com cacheLock
+void __diskCacheWaitLoads(Disk *d) {
+	while (d->cacheLoading)
+		pthread_cond_wait (&d->cacheLoaded, &d->cacheLock);
+}
+
+//Funcao interna que compara enderecos de entradas da cache, para ordenar a
+//gravacao das entradas sujas
+int __diskCacheCompare(const void *a, const void *b) {
+	const DiskCacheEntry *x = *(DiskCacheEntry* const*) a;
+	const DiskCacheEntry *y = *(DiskCacheEntry* const*) b;
+	return (x->addr < y->addr ? -1 : (x->addr > y->addr));
+}
+
+//Funcao interna que grava no disco todas as entradas sujas da cache, em
+//ordem crescente de endereco e agrupando setores contiguos numa unica
+//transferencia. Deve ser chamada com cacheLock. Retorna 0 ou -1 em caso de
+//falha
+int __diskCacheFlush(Disk *d) {
+	DiskCacheEntry **dirty;
+	unsigned char *buf;
+	unsigned int n = 0;
+	int result = 0;
+	if (!d->cacheCap) return 0;
+	dirty = malloc (d->cacheCap * sizeof (DiskCacheEntry*));
+	buf = malloc (d->cacheCap * DISK_SECTORDATASIZE);
+	if (!dirty || !buf) {
+		free (dirty); free (buf);
+		return -1;
+	}
+	for (unsigned int e = 0; e < d->cacheCap; e++)
+		if (d->cache[e].dirty) dirty[n++] = &d->cache[e];
+	qsort (dirty, n, sizeof (DiskCacheEntry*), __diskCacheCompare);
+
+	for (unsigned int i = 0; i < n; ) {
+		unsigned int j = i + 1;
+		memcpy (buf, dirty[i]->data, DISK_SECTORDATASIZE);
+		while (j < n && dirty[j]->addr == dirty[j-1]->addr + 1) {
+			memcpy (buf + (j - i) * DISK_SECTORDATASIZE,
+			        dirty[j]->data, DISK_SECTORDATASIZE);
+			j++;
+		}
+		if (__diskMediaWrite (d, dirty[i]->addr, j - i, buf) < 0)
+			result = -1;
+		else
+			for (unsigned int k = i; k < j; k++)
+				dirty[k]->dirty = 0;
+		i = j;
+	}
+	free (dirty);
+	free (buf);
+	return result;
+}
+
+//Funcao interna que libera a cache de um disco, sem gravar entradas sujas
+void __diskCacheFree(Disk *d) {
+	free (d->cache);
+	free (d->cacheHash);
+	d->cache = NULL;
+	d->cacheHash = NULL;
+	d->cacheCap = d->cacheBuckets = 0;
+	d->cacheHead = d->cacheTail = d->cacheFree = -1;
+}
+
+//Funcao interna que aloca uma cache vazia de capacity setores para um disco.
+//Retorna 0 ou -1 em caso de falha
+int __diskCacheInit(Disk *d, unsigned int capacity) {
+	__diskCacheFree (d);
+	if (!capacity) return 0;
+	d->cacheBuckets = 2 * capacity;
+	d->cache = malloc (capacity * sizeof (DiskCacheEntry));
+	d->cacheHash = malloc (d->cacheBuckets * sizeof (int));
+	if (!d->cache || !d->cacheHash) {
+		__diskCacheFree (d);
+		return -1;
+	}
+	for (unsigned int b = 0; b < d->cacheBuckets; b++)
+		d->cacheHash[b] = -1;
+	for (unsigned int e = 0; e < capacity; e++) {
+		d->cache[e].dirty = 0;
+		d->cache[e].busy = 0;
+		d->cache[e].next = (e + 1 < capacity ? (int) e + 1 : -1);
+	}
+	d->cacheFree = 0;
+	d->cacheCap = capacity;
+	return 0;
+}
+
+//Funcao interna que le count setores contiguos, ja validados, atraves da
+//cache. Leituras de um unico setor sao atendidas pela cache e a alimentam.
+//Leituras de varios setores sao atendidas pela cache apenas se todos
+//estiverem presentes; caso contrario vao ao disco numa unica transferencia,
+//sem alimentar a cache, e as copias em cache (possivelmente sujas)
+//prevalecem sobre os dados lidos. A leitura do meio e' feita sem cacheLock;
+//a entrada de um setor ausente fica ocupada ate ser preenchida
+int __diskCachedRead(Disk *d, unsigned long addr, unsigned long count,
+                     unsigned char *data) {
+	unsigned long hits = 0;
+	int e = -1, result = 0;
+	pthread_mutex_lock (&d->cacheLock);
+	//Setores ainda sendo lidos por outra operacao sao aguardados
+	while (__diskCacheBusy (d, addr, count))
+		pthread_cond_wait (&d->cacheLoaded, &d->cacheLock);
+	if (!d->cacheCap) {
+		pthread_mutex_unlock (&d->cacheLock);
+		return __diskMediaRead (d, addr, count, data);
+	}
+	for (unsigned long i = 0; i < count; i++)
+		if (__diskCacheLookup (d, addr + i) >= 0) hits++;
+	d->cacheHits += hits;
+	d->cacheMisses += count - hits;
+
+	if (hits < count) {
+		if (count == 1 && (e = __diskCacheAlloc (d, addr)) >= 0) {
+			d->cache[e].busy = 1;
+			d->cacheLoading++;
+		}
+		pthread_mutex_unlock (&d->cacheLock);
+		result = __diskMediaRead (d, addr, count, data);
+		pthread_mutex_lock (&d->cacheLock);
+	}
+	if (e >= 0) {
+		//Gravado durante a leitura: a copia em cache e' mais recente
+		if (d->cache[e].busy == 2) result = 0;
+		else if (result == 0)
+			memcpy (d->cache[e].data, data, DISK_SECTORDATASIZE);
+		d->cache[e].busy = 0;
+		if (result < 0) __diskCacheDrop (d, e);
+		d->cacheLoading--;
+		pthread_cond_broadcast (&d->cacheLoaded);
+	}
+
+	if (result == 0)
+		for (unsigned long i = 0; i < count; i++) {
+			e = __diskCacheLookup (d, addr + i);
+			if (e < 0 || d->cache[e].busy == 1) continue;
+			memcpy (data + i * DISK_SECTORDATASIZE, d->cache[e].data,
+			        DISK_SECTORDATASIZE);
+			__diskCacheTouch (d, e);
+		}
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao interna que grava count setores contiguos, ja validados, atraves da
+//cache. A escrita de um unico setor fica na cache, marcada como suja, ate
+//ser descartada ou ate diskFlush; sem entrada disponivel, vai direto ao
+//disco. Escritas de varios setores vao direto ao disco, atualizando as copias
+//ja presentes na cache. Uma entrada ocupada por uma leitura do meio recebe os
+//dados gravados, que prevalecem sobre os lidos
+int __diskCachedWrite(Disk *d, unsigned long addr, unsigned long count,
+                      unsigned char *data) {
+	int e, result = 0;
+	pthread_mutex_lock (&d->cacheLock);
+	if (count == 1) {
+		e = __diskCacheLookup (d, addr);
+		if (e < 0) e = __diskCacheAlloc (d, addr);
+		if (e < 0) result = __diskMediaWrite (d, addr, 1, data);
+		else {
+			memcpy (d->cache[e].data, data, DISK_SECTORDATASIZE);
+			d->cache[e].dirty = 1;
+			if (d->cache[e].busy) d->cache[e].busy = 2;
+			__diskCacheTouch (d, e);
+		}
+	}
+	else {
+		result = __diskMediaWrite (d, addr, count, data);
+		if (result == 0)
+			for (unsigned long i = 0; i < count; i++) {
+				e = __diskCacheLookup (d, addr + i);
+				if (e < 0) continue;
+				memcpy (d->cache[e].data,
+				        data + i * DISK_SECTORDATASIZE,
+				        DISK_SECTORDATASIZE);
+				d->cache[e].dirty = 0;
+				if (d->cache[e].busy) d->cache[e].busy = 2;
+			}
+	}
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao interna que libera a memoria e os mutexes de um Disk, sem gravar a
+//cache nem fechar o meio fisico
+void __diskRelease(Disk *d) {
+	__diskCacheFree (d);
+	pthread_mutex_destroy (&d->headLock);
+	pthread_mutex_destroy (&d->queueLock);
+	pthread_mutex_destroy (&d->asyncLock);
+	pthread_cond_destroy (&d->asyncSubmitted);
+	pthread_cond_destroy (&d->asyncCompleted);
+	pthread_mutex_destroy (&d->cacheLock);
+	pthread_cond_destroy (&d->cacheLoaded);
+	pthread_mutex_destroy (&d->traceLock);
+	pthread_mutex_destroy (&d->trackLock);
+	free(d->track);
+	free(d->members);
+	free(d->heat);
+	free(d->queue);
+	free(d);
+}
+
+//Funcao interna que aloca e inicializa um Disk de numSectors setores, ainda
+//sem meio fisico associado (fd = -1). Retorna NULL se nao houver memoria
+Disk* __diskAlloc(int id, unsigned long numSectors) {
+	Disk *d = malloc(sizeof (Disk));
+	if (!d) return NULL;
+	d->id = id;
+	d->kind = DISK_KINDFILE;
+	d->fd = -1;
+	d->format = DISK_FORMATFRAMED;
+	d->members = NULL;
+	d->numMembers = 0;
+	d->stripeUnit = 0;
+	d->mirrorNext = 0;
+	d->numSectors = numSectors;
+	d->numCylinders = d->numSectors / DISK_SECTORSPERTRACK;
+	d->size = d->numSectors * DISK_SECTORDATASIZE;
+	d->currCylinder = 0;
+	d->realTime = 0;
+	d->verify = 1;
+	d->simTime = 0;
+	diskGetLatencyPreset (DISK_LATENCYLINEAR, &d->model);
+	memset (&d->stats, 0, sizeof (DiskStats));
+	d->heat = calloc (d->numCylinders + 1, sizeof (unsigned long));
+	if (!d->heat) {
+		free (d);
+		return NULL;
+	}
+	pthread_mutex_init (&d->headLock, NULL);
+	d->queue = NULL;
+	d->queueLen = d->queueCap = 0;
+	d->seekFCFS = d->seekSched = 0;
+	d->sched = DISK_SCHEDCLOOK;
+	d->prioAgeLimit = DISK_PRIOAGELIMIT;
+	pthread_mutex_init (&d->queueLock, NULL);
+	d->asyncSQ = d->asyncCQ = d->asyncBatch = NULL;
+	d->asyncDepth = d->sqHead = d->sqLen = d->cqHead = d->cqLen = 0;
+	d->asyncInFlight = 0;
+	d->asyncStop = 0;
+	pthread_mutex_init (&d->asyncLock, NULL);
+	pthread_cond_init (&d->asyncSubmitted, NULL);
+	pthread_cond_init (&d->asyncCompleted, NULL);
+	d->map = NULL;
+	d->mapSize = 0;
+	d->cache = NULL;
+	d->cacheHash = NULL;
+	__diskCacheFree (d);
+	d->cacheHits = d->cacheMisses = 0;
+	d->cacheLoading = 0;
+	pthread_mutex_init (&d->cacheLock, NULL);
+	pthread_cond_init (&d->cacheLoaded, NULL);
+	d->trace = NULL;
+	pthread_mutex_init (&d->traceLock, NULL);
+	d->track = NULL;
+	d->trackClock = 0;
+	pthread_mutex_init (&d->trackLock, NULL);
+	if (__diskCacheInit (d, DISK_DEFAULTCACHESECTORS) < 0) {
+		__diskRelease (d);
+		return NULL;
+	}
+	return d;
 }
 
 //Funcao que conecta um disco fisico ao sistema operacional.
@@ -62,25 +1384,366 @@ void __diskSeek(Disk *d, unsigned long addr) {
 //pelo sistema operacional. Se o disco existir, retorna um ponteiro para Disk.
 //Caso contrario, retorna NULL
 Disk* diskConnect(int id, char* rawDiskPath) {
+	return diskConnectMode (id, rawDiskPath, DISK_MODEFILE);
+}
+
+//Funcao interna que conecta, no modo mode, o disco fisico do arquivo ja
+//aberto fd, reconhecendo seu formato. O descritor passa a pertencer ao disco
+//e e' fechado em caso de falha. Retorna um ponteiro para Disk ou NULL
+Disk* __diskConnectFd(int id, int fd, int mode) {
 	Disk* d = NULL;
-	FILE *fp = fopen(rawDiskPath,"r+");
-	if (fp!=NULL) {
-		d = malloc(sizeof (Disk));
-		d->id = id;
-		d->fp = fp;
-		fseek (fp, 0, SEEK_END);
-		d->numSectors = ftell (fp) / DISK_SECTORTOTALSIZE;
-		d->numCylinders = d->numSectors / DISK_SECTORSPERTRACK;
-		d->size = d->numSectors * DISK_SECTORDATASIZE;
-		d->currCylinder = 0;
+	unsigned char header[16];
+	unsigned long numSectors;
+	off_t fileSize;
+	int format = DISK_FORMATFRAMED;
+	fileSize = lseek (fd, 0, SEEK_END);
+	numSectors = fileSize / DISK_SECTORTOTALSIZE;
+	//O formato e' reconhecido pela assinatura do cabecalho alinhado
+	if (fileSize >= DISK_ALIGNEDHEADERSIZE &&
+	    __diskPread (fd, header, sizeof (header), 0) == 0 &&
+	    memcmp (header, DISK_ALIGNEDMAGIC, 8) == 0) {
+		format = DISK_FORMATALIGNED;
+		numSectors = __diskGetLE (header + 8, 8);
+		if (__diskAlignedPos (numSectors) > fileSize) fileSize = -1;
+	}
+	if (fileSize >= 0)
+		d = __diskAlloc (id, numSectors);
+	if (!d) {
+		close (fd);
+		return NULL;
+	}
+	d->fd = fd;
+	d->format = format;
+	if (mode == DISK_MODEMMAP && __diskMapFile (d) < 0) {
+		diskDisconnect (d);
+		return NULL;
+	}
+	return d;
+}
+
+//Funcao que conecta um disco fisico ao sistema operacional, como
+//diskConnect, escolhendo o modo de acesso ao arquivo do disco: DISK_MODEFILE
+//(leitura e escrita posicionais no arquivo) ou DISK_MODEMMAP (arquivo
+//mapeado em memoria). O formato do arquivo (DISK_FORMAT*) e' reconhecido
+//automaticamente. Retorna um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectMode(int id, char* rawDiskPath, int mode) {
+	int fd;
+	if (mode != DISK_MODEFILE && mode != DISK_MODEMMAP) return NULL;
+	fd = open (rawDiskPath, O_RDWR);
+	if (fd < 0) return NULL;
+	return __diskConnectFd (id, fd, mode);
+}
+
+//Funcao que conecta um volume virtual que distribui (RAID-0) seus setores
+//entre numMembers discos fisicos, cujos arquivos sao dados por rawDiskPaths.
+//Faixas consecutivas de stripeUnit setores sao alternadas entre os membros,
+//cujas cabecas se movem de forma independente. O volume tem a mesma
+//interface de um disco fisico e a desconexao do volume desconecta tambem os
+//membros. Retorna um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectStriped(int id, char** rawDiskPaths, unsigned int numMembers,
+                         unsigned long stripeUnit) {
+	Disk *d, **members;
+	unsigned long perMember = 0;
+	if (numMembers == 0 || stripeUnit == 0 || !rawDiskPaths) return NULL;
+	members = calloc (numMembers, sizeof (Disk*));
+	if (!members) return NULL;
+	for (unsigned int m = 0; m < numMembers; m++) {
+		members[m] = diskConnect (id, rawDiskPaths[m]);
+		if (!members[m]) break;
+		//A cache fica no volume, nao nos membros
+		diskSetCacheCapacity (members[m], 0);
+		if (m == 0 || members[m]->numSectors < perMember)
+			perMember = members[m]->numSectors;
+	}
+	perMember -= perMember % stripeUnit;
+	d = NULL;
+	if (members[numMembers-1] && perMember > 0)
+		d = __diskAlloc (id, perMember * numMembers);
+	if (!d) {
+		for (unsigned int m = 0; m < numMembers && members[m]; m++)
+			diskDisconnect (members[m]);
+		free (members);
+		return NULL;
+	}
+	d->kind = DISK_KINDSTRIPE;
+	d->members = members;
+	d->numMembers = numMembers;
+	d->stripeUnit = stripeUnit;
+	return d;
+}
+
+//Funcao interna que conecta um disco em memoria com numSectors setores, como
+//diskConnectMemory, mas sem exigir um numero inteiro de cilindros. Retorna
+//um ponteiro para Disk ou NULL em caso de falha
+Disk* __diskConnectMemorySectors(int id, unsigned long numSectors) {
+	Disk *d;
+	void *map;
+	if (numSectors == 0) return NULL;
+	d = __diskAlloc (id, numSectors);
+	if (!d) return NULL;
+	d->kind = DISK_KINDMEMORY;
+	d->mapSize = d->numSectors * DISK_SECTORTOTALSIZE;
+	//Paginas anonimas sao zeradas sob demanda: quadros zerados sao lidos
+	//como setores em branco, como os buracos de um disco esparso
+	map = mmap (NULL, d->mapSize, PROT_READ | PROT_WRITE,
+	            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		__diskRelease (d);
+		return NULL;
+	}
+	d->map = map;
+	return d;
+}
+
+//Funcao que conecta um disco fisico mantido inteiramente na memoria do
+//processo, com numCylinders cilindros de setores em branco. O disco tem a
+//mesma interface, o mesmo formato de quadros e a mesma contabilizacao de um
+//disco sobre arquivo, sem E/S no sistema hospedeiro. O conteudo e' perdido
+//na desconexao, a menos que salvo por diskSaveMemory. Retorna um ponteiro
+//para Disk ou NULL em caso de falha
+Disk* diskConnectMemory(int id, unsigned long numCylinders) {
+	return __diskConnectMemorySectors (id, numCylinders
+	                                   * DISK_SECTORSPERTRACK);
+}
+
+//Funcao que grava o conteudo do disco em memoria d no arquivo rawDiskPath,
+//como um disco fisico no formato com enquadramento que pode ser conectado
+//por diskConnect ou carregado por diskLoadMemory. Os setores pendentes na
+//cache sao gravados antes; setores nunca gravados ficam como buracos do
+//arquivo. Nao ha custo no relogio simulado. O disco nao deve ser alterado
+//durante a gravacao. Retorna 0 se bem sucedido e -1 caso contrario
+int diskSaveMemory (Disk* d, char* rawDiskPath) {
+	int fd, result;
+	if (!d || d->kind != DISK_KINDMEMORY) return -1;
+	result = diskFlush (d);
+	if (result == 0)
+		result = diskCreateRawDiskSparse (rawDiskPath, __diskHeatSize (d));
+	if (result < 0) return -1;
+	fd = open (rawDiskPath, O_RDWR);
+	if (fd < 0) return -1;
+	//Um cilindro final parcial e' preservado como tal
+	if (ftruncate (fd, __diskFramePos (d->numSectors)) != 0) result = -1;
+	//Sequencias de quadros ja gravados, numa unica escrita cada
+	for (unsigned long a = 0; a < d->numSectors && result == 0; ) {
+		unsigned long b = a;
+		while (b < d->numSectors &&
+		       !__diskFrameIsHole (__diskMapFrame (d, b)))
+			b++;
+		if (b > a)
+			result = __diskPwrite (fd, __diskMapFrame (d, a),
+			                       (b - a) * DISK_SECTORTOTALSIZE,
+			                       __diskFramePos (a));
+		a = b + 1;
+	}
+	if (close (fd) != 0) result = -1;
+	return result;
+}
+
+//Funcao que conecta um disco em memoria, como diskConnectMemory, com o
+//conteudo do disco fisico do arquivo rawDiskPath, em qualquer formato e com
+//o mesmo numero de setores, inclusive os de um cilindro final parcial. O
+//arquivo nao e' alterado nem mantido aberto. Retorna um ponteiro para Disk ou
+//NULL em caso de falha
+Disk* diskLoadMemory(int id, char* rawDiskPath) {
+	Disk *src, *d = NULL;
+	unsigned char *buf;
+	int result = 0;
+	src = diskConnect (id, rawDiskPath);
+	if (!src) return NULL;
+	diskSetCacheCapacity (src, 0);
+	buf = malloc (DISK_CYLINDERSIZE);
+	if (buf) d = __diskConnectMemorySectors (id, src->numSectors);
+	//Quadros copiados como estao, preservando somas e buracos; no formato
+	//alinhado, os setores que nao estao em branco sao enquadrados. Um
+	//cilindro final parcial e' copiado com seus setores
+	for (unsigned long c = 0; d && c < __diskHeatSize (d) && result == 0; c++) {
+		unsigned long first = c * DISK_SECTORSPERTRACK;
+		unsigned long n = d->numSectors - first;
+		if (n > DISK_SECTORSPERTRACK) n = DISK_SECTORSPERTRACK;
+		if (src->format == DISK_FORMATALIGNED) {
+			result = __diskPread (src->fd, buf, n * DISK_SECTORDATASIZE,
+			                      __diskAlignedPos (first));
+			for (unsigned long i = 0; i < n && result == 0; i++)
+				if (!__diskIsBlank (buf + i * DISK_SECTORDATASIZE))
+					__diskFramePut (__diskMapFrame (d, first + i),
+					                buf + i * DISK_SECTORDATASIZE);
+			continue;
+		}
+		result = __diskPread (src->fd, buf, n * DISK_SECTORTOTALSIZE,
+		                      __diskFramePos (first));
+		for (unsigned long i = 0; i < n && result == 0; i++)
+			if (!__diskFrameIsHole (buf + i * DISK_SECTORTOTALSIZE))
+				memcpy (__diskMapFrame (d, first + i),
+				        buf + i * DISK_SECTORTOTALSIZE,
+				        DISK_SECTORTOTALSIZE);
+	}
+	if (d && result < 0) {
+		diskDisconnect (d);
+		d = NULL;
+	}
+	diskDisconnect (src);
+	free (buf);
+	return d;
+}
+
+//Funcao que conecta um volume virtual espelhado (RAID-1) sobre numMembers
+//discos fisicos, cujos arquivos sao dados por rawDiskPaths, com o tamanho do
+//menor deles. Gravacoes vao para todos os membros. Cada leitura e' atendida
+//pelo membro cuja cabeca esta' mais proxima do setor pedido, de modo que
+//fluxos de leitura em regioes distintas tendem a usar membros distintos, e
+//uma leitura que falhe num membro e' repetida nos demais. A desconexao do
+//volume desconecta tambem os membros. Retorna um ponteiro para Disk ou NULL
+//em caso de falha
+Disk* diskConnectMirrored(int id, char** rawDiskPaths,
+                          unsigned int numMembers) {
+	Disk *d, **members;
+	unsigned long numSectors = 0;
+	if (numMembers == 0 || !rawDiskPaths) return NULL;
+	members = calloc (numMembers, sizeof (Disk*));
+	if (!members) return NULL;
+	for (unsigned int m = 0; m < numMembers; m++) {
+		members[m] = diskConnect (id, rawDiskPaths[m]);
+		if (!members[m]) break;
+		//A cache fica no volume, nao nos membros
+		diskSetCacheCapacity (members[m], 0);
+		if (m == 0 || members[m]->numSectors < numSectors)
+			numSectors = members[m]->numSectors;
+	}
+	d = NULL;
+	if (members[numMembers-1] && numSectors > 0)
+		d = __diskAlloc (id, numSectors);
+	if (!d) {
+		for (unsigned int m = 0; m < numMembers && members[m]; m++)
+			diskDisconnect (members[m]);
+		free (members);
+		return NULL;
 	}
+	d->kind = DISK_KINDMIRROR;
+	d->members = members;
+	d->numMembers = numMembers;
 	return d;
 }
 
-//Funcao que disconecta um disco fisico do sistema operacional
+//Funcao que conecta uma sobreposicao com copia na escrita ao disco fisico
+//base do arquivo basePath, que nao e' alterado: setores gravados ficam
+//apenas no delta, um disco fisico esparso no arquivo deltaPath, criado com a
+//geometria da base se ainda nao existir. Leituras de setores nunca gravados
+//na sobreposicao sao atendidas pela base. A base pode ser compartilhada por
+//varias sobreposicoes e ter apenas permissao de leitura. O volume tem a
+//mesma interface de um disco fisico, com um unico relogio simulado. Retorna
+//um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectOverlay(int id, char* basePath, char* deltaPath) {
+	Disk *d = NULL, **members;
+	int fd;
+	members = calloc (2, sizeof (Disk*));
+	if (!members) return NULL;
+	fd = open (basePath, O_RDWR);
+	if (fd < 0) fd = open (basePath, O_RDONLY);
+	if (fd >= 0) members[0] = __diskConnectFd (id, fd, DISK_MODEFILE);
+	//Um cilindro final parcial da base tambem e' coberto pelo delta
+	if (members[0] && access (deltaPath, F_OK) != 0 &&
+	    (diskCreateRawDiskSparse (deltaPath, __diskHeatSize (members[0])) < 0
+	     || (members[0]->numSectors % DISK_SECTORSPERTRACK != 0 &&
+	         __diskTrimRawDisk (deltaPath, DISK_FORMATFRAMED,
+	                            members[0]->numSectors) < 0)))
+		members[0]->numSectors = 0;
+	if (members[0] && members[0]->numSectors > 0)
+		members[1] = diskConnect (id, deltaPath);
+	//O delta precisa cobrir a base e estar no formato com enquadramento
+	if (members[1] && members[1]->format == DISK_FORMATFRAMED &&
+	    members[1]->numSectors >= members[0]->numSectors)
+		d = __diskAlloc (id, members[0]->numSectors);
+	if (!d) {
+		for (int m = 0; m < 2; m++)
+			if (members[m]) diskDisconnect (members[m]);
+		free (members);
+		return NULL;
+	}
+	//A cache fica no volume, nao nos membros
+	diskSetCacheCapacity (members[0], 0);
+	diskSetCacheCapacity (members[1], 0);
+	d->kind = DISK_KINDOVERLAY;
+	d->members = members;
+	d->numMembers = 2;
+	return d;
+}
+
+//Funcao que descarta todos os setores gravados numa sobreposicao, que volta
+//a ser lida como a base. Copias na cache sao descartadas sem gravacao e o
+//delta e' esvaziado. Retorna 0 se bem sucedido e -1 caso contrario
+int diskOverlayDiscard (Disk* d) {
+	Disk *delta;
+	off_t size;
+	int result = 0;
+	if (!d || d->kind != DISK_KINDOVERLAY) return -1;
+	delta = d->members[1];
+	size = (off_t) delta->numSectors * DISK_SECTORTOTALSIZE;
+	pthread_mutex_lock (&d->cacheLock);
+	__diskCacheWaitLoads (d);
+	while (d->cacheHead >= 0)
+		__diskCacheDrop (d, d->cacheHead);
+	if (ftruncate (delta->fd, 0) != 0 || ftruncate (delta->fd, size) != 0)
+		result = -1;
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao que incorpora a base os setores gravados numa sobreposicao, que
+//passam a ser lidos da base, e esvazia o delta. Os setores pendentes na
+//cache sao gravados antes. A base deve ter permissao de escrita e nao estar
+//em uso por outras sobreposicoes. Nao ha custo no relogio simulado do volume.
+//Retorna 0 se bem sucedido e -1 caso contrario
+int diskOverlayCommit (Disk* d) {
+	Disk *base, *delta;
+	unsigned char *frames, *buf;
+	int result = 0;
+	if (!d || d->kind != DISK_KINDOVERLAY || diskFlush (d) < 0) return -1;
+	base = d->members[0];
+	delta = d->members[1];
+	frames = malloc (DISK_CYLINDERSIZE);
+	buf = malloc (DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE);
+	if (!frames || !buf) result = -1;
+	//Um cilindro do delta por vez, copiando as sequencias de setores
+	//gravados. Um cilindro final parcial e' copiado com seus setores
+	for (unsigned long c = 0; c < __diskHeatSize (base) && result == 0; c++) {
+		unsigned long first = c * DISK_SECTORSPERTRACK;
+		unsigned long n = base->numSectors - first;
+		if (n > DISK_SECTORSPERTRACK) n = DISK_SECTORSPERTRACK;
+		result = __diskPread (delta->fd, frames, n * DISK_SECTORTOTALSIZE,
+		                      __diskFramePos (first));
+		for (unsigned long i = 0; i < n && result == 0; ) {
+			unsigned long j = i;
+			while (j < n && result == 0 &&
+			       !__diskFrameIsHole (frames
+			                           + j * DISK_SECTORTOTALSIZE)) {
+				result = __diskFrameGet (d, frames 
+				         + j * DISK_SECTORTOTALSIZE,
+				         buf + (j - i) * DISK_SECTORDATASIZE);
+				j++;
+			}
+			if (j > i && result == 0)
+				result = diskWriteSectors (base, first + i, j - i,
+				                           buf);
+			i = j + 1;
+		}
+	}
+	free (frames);
+	free (buf);
+	if (result == 0) result = diskOverlayDiscard (d);
+	return result;
+}
+
+//Funcao que disconecta um disco fisico do sistema operacional. Setores
+//pendentes na cache sao gravados antes da desconexao
 int diskDisconnect(Disk* d) {
-	int result = fclose (d->fp);
-	free(d);
+	int result = diskAsyncStop (d);
+	if (diskFlush (d) != 0) result = -1;
+	if (diskTraceStop (d) != 0) result = -1;
+	if (__diskUnmapFile (d) != 0) result = -1;
+	if (d->fd >= 0 && close (d->fd) != 0) result = -1;
+	for (unsigned int m = 0; m < d->numMembers; m++)
+		if (diskDisconnect (d->members[m]) != 0) result = -1;
+	__diskRelease (d);
 	return result;
 }
 
@@ -90,6 +1753,12 @@ int diskGetId (Disk* d) {
 	return d->id;
 }
 
+//Funcao que retorna o formato do arquivo de um disco fisico: DISK_FORMATFRAMED
+//ou DISK_FORMATALIGNED
+int diskGetFormat (Disk* d) {
+	return d->format;
+}
+
 //Funcao que retorna o numero total de setores de um disco fisico
 unsigned long diskGetNumSectors (Disk* d) {
 	return d->numSectors;
@@ -109,7 +1778,211 @@ unsigned long diskGetSize (Disk* d) {
 //Funcao que retorna o cilindro sobre o qual as cabecas estao atualmente
 //posicionadas em um disco
 unsigned long diskGetCurrentCylinder (Disk* d) {
-	return d->currCylinder;
+	unsigned long cyl;
+	pthread_mutex_lock (&d->headLock);
+	cyl = d->currCylinder;
+	pthread_mutex_unlock (&d->headLock);
+	return cyl;
+}
+
+//Funcao que retorna o tempo simulado, em microssegundos, consumido pelos
+//deslocamentos da cabeca e pelas transferencias de setores do disco desde a
+//conexao ou o ultimo diskResetSimTime
+unsigned long diskGetElapsedSimTime (Disk* d) {
+	unsigned long t;
+	pthread_mutex_lock (&d->headLock);
+	t = d->simTime;
+	pthread_mutex_unlock (&d->headLock);
+	return t;
+}
+
+//Funcao que zera o relogio simulado de um disco
+void diskResetSimTime (Disk* d) {
+	pthread_mutex_lock (&d->headLock);
+	d->simTime = 0;
+	pthread_mutex_unlock (&d->headLock);
+}
+
+//Funcao que liga (enabled nao nulo) ou desliga o modo de tempo real de um
+//disco. Em tempo real, o posicionamento da cabeca insere um atraso real; caso
+//contrario, o custo e' apenas contabilizado no relogio simulado. Discos sao
+//conectados com o tempo real desligado
+void diskSetRealTime (Disk* d, int enabled) {
+	pthread_mutex_lock (&d->headLock);
+	d->realTime = (enabled != 0);
+	pthread_mutex_unlock (&d->headLock);
+}
+
+//Funcao que retorna 1 se o disco estiver em modo de tempo real e 0 caso
+//contrario
+int diskGetRealTime (Disk* d) {
+	int enabled;
+	pthread_mutex_lock (&d->headLock);
+	enabled = d->realTime;
+	pthread_mutex_unlock (&d->headLock);
+	return enabled;
+}
+
+//Funcao que preenche *m com o modelo de latencia predefinido preset:
+//DISK_LATENCYLINEAR (10 ms por cilindro e 100 us por setor, sem espera
+//rotacional) ou DISK_LATENCYROTATIONAL (curva de deslocamento com
+//acomodacao, rotacao a 7200 rpm e transferencia de um setor da trilha por
+//1/64 de volta). Retorna 0 se bem sucedido e -1 caso contrario
+int diskGetLatencyPreset (int preset, DiskLatencyModel *m) {
+	if (!m) return -1;
+	memset (m, 0, sizeof (DiskLatencyModel));
+	if (preset == DISK_LATENCYLINEAR) {
+		m->seekLongCoef = DISK_SEEKDELAY * 1000;
+		m->transferTime = DISK_SECTORTRANSFERTIME;
+		return 0;
+	}
+	if (preset == DISK_LATENCYROTATIONAL) {
+		m->settleTime = DISK_ROTSETTLETIME;
+		m->seekShortCoef = DISK_ROTSHORTCOEF;
+		m->seekShortLimit = DISK_ROTSHORTLIMIT;
+		m->seekLongCoef = DISK_ROTLONGCOEF;
+		m->rotationTime = DISK_ROTATIONTIME;
+		return 0;
+	}
+	return -1;
+}
+
+//Funcao que troca o modelo de latencia usado no relogio simulado e nos
+//atrasos de tempo real de um disco. Num volume virtual, o modelo e' trocado
+//nos membros. Discos sao conectados com DISK_LATENCYLINEAR
+void diskSetLatencyModel (Disk* d, const DiskLatencyModel *m) {
+	pthread_mutex_lock (&d->headLock);
+	d->model = *m;
+	pthread_mutex_unlock (&d->headLock);
+	for (unsigned int i = 0; i < d->numMembers; i++)
+		diskSetLatencyModel (d->members[i], m);
+}
+
+//Funcao que copia para *m o modelo de latencia de um disco
+void diskGetLatencyModel (Disk* d, DiskLatencyModel *m) {
+	pthread_mutex_lock (&d->headLock);
+	*m = d->model;
+	pthread_mutex_unlock (&d->headLock);
+}
+
+//Funcao que liga (enabled nao nulo) ou desliga a verificacao, a cada leitura
+//do meio fisico, da soma CRC32C gravada com cada setor. Uma leitura de setor
+//com soma incorreta falha e e' contada nas estatisticas. Discos sao
+//conectados com a verificacao ligada
+void diskSetVerifyOnRead (Disk* d, int enabled) {
+	pthread_mutex_lock (&d->headLock);
+	d->verify = (enabled != 0);
+	pthread_mutex_unlock (&d->headLock);
+	for (unsigned int m = 0; m < d->numMembers; m++)
+		diskSetVerifyOnRead (d->members[m], enabled);
+}
+
+//Funcao que retorna 1 se a verificacao na leitura estiver ligada e 0 caso
+//contrario
+int diskGetVerifyOnRead (Disk* d) {
+	int enabled;
+	pthread_mutex_lock (&d->headLock);
+	enabled = d->verify;
+	pthread_mutex_unlock (&d->headLock);
+	return enabled;
+}
+
+//Funcao que copia para *stats as estatisticas de uso de um disco, acumuladas
+//desde a conexao ou o ultimo diskResetStats
+void diskGetStats (Disk* d, DiskStats *stats) {
+	pthread_mutex_lock (&d->headLock);
+	*stats = d->stats;
+	pthread_mutex_unlock (&d->headLock);
+	pthread_mutex_lock (&d->cacheLock);
+	stats->cacheHits = d->cacheHits;
+	stats->cacheMisses = d->cacheMisses;
+	pthread_mutex_unlock (&d->cacheLock);
+}
+
+//Funcao que copia para *stats as estatisticas de uso do membro m de um
+//volume virtual (distribuido, espelhado ou sobreposicao, em que o membro 0
+//e' a base e o 1, o delta). Retorna 0 se bem sucedido e -1 se o disco nao
+//tiver o membro m
+int diskGetMemberStats (Disk* d, unsigned int m, DiskStats *stats) {
+	if (m >= d->numMembers) return -1;
+	diskGetStats (d->members[m], stats);
+	return 0;
+}
+
+//Funcao que retorna o numero de setores acessados no cilindro cyl (mapa de
+//calor de acessos), ou 0 se o cilindro for invalido. Um cilindro final
+//parcial tem entrada propria, de numero numCylinders
+unsigned long diskGetCylinderHeat (Disk* d, unsigned long cyl) {
+	unsigned long heat;
+	if (cyl >= __diskHeatSize (d)) return 0;
+	pthread_mutex_lock (&d->headLock);
+	heat = d->heat[cyl];
+	pthread_mutex_unlock (&d->headLock);
+	return heat;
+}
+
+//Funcao que zera as estatisticas de uso e o mapa de calor de um disco
+void diskResetStats (Disk* d) {
+	pthread_mutex_lock (&d->headLock);
+	memset (&d->stats, 0, sizeof (DiskStats));
+	memset (d->heat, 0, __diskHeatSize (d) * sizeof (unsigned long));
+	pthread_mutex_unlock (&d->headLock);
+	pthread_mutex_lock (&d->cacheLock);
+	d->cacheHits = d->cacheMisses = 0;
+	pthread_mutex_unlock (&d->cacheLock);
+}
+
+//Funcao que grava as estatisticas de uso de um disco no arquivo CSV indicado
+//por csvPath, com linhas no formato tipo,chave,valor: contadores (counter),
+//requisicoes e latencias por classe de prioridade (priorequests,
+//priolatency e priomaxlatency, chave = classe), histograma de distancias de
+//deslocamento (seekhist, chave = menor distancia do intervalo) e mapa de
+//calor por cilindro (cylinder). Retorna 0 se bem sucedido e -1 caso
+//contrario
+int diskDumpStatsCSV (Disk* d, char* csvPath) {
+	DiskStats st;
+	unsigned long *heat;
+	FILE *fp;
+	int result = 0;
+	unsigned long numHeat = __diskHeatSize (d);
+	heat = malloc ((numHeat + 1) * sizeof (unsigned long));
+	if (!heat) return -1;
+	diskGetStats (d, &st);
+	pthread_mutex_lock (&d->headLock);
+	memcpy (heat, d->heat, numHeat * sizeof (unsigned long));
+	pthread_mutex_unlock (&d->headLock);
+
+	fp = fopen (csvPath, "w");
+	if (!fp) {
+		free (heat);
+		return -1;
+	}
+	fprintf (fp, "type,key,value\n");
+	fprintf (fp, "counter,sectorsRead,%lu\n", st.sectorsRead);
+	fprintf (fp, "counter,sectorsWritten,%lu\n", st.sectorsWritten);
+	fprintf (fp, "counter,numSeeks,%lu\n", st.numSeeks);
+	fprintf (fp, "counter,cylindersTraversed,%lu\n", 
+	         st.cylindersTraversed);
+	fprintf (fp, "counter,cacheHits,%lu\n", st.cacheHits);
+	fprintf (fp, "counter,cacheMisses,%lu\n", st.cacheMisses);
+	fprintf (fp, "counter,checksumErrors,%lu\n", st.checksumErrors);
+	fprintf (fp, "counter,trackHits,%lu\n", st.trackHits);
+	fprintf (fp, "counter,prioPromoted,%lu\n", st.prioPromoted);
+	for (int c = 0; c < DISK_PRIOCLASSES; c++) {
+		fprintf (fp, "priorequests,%d,%lu\n", c, st.prioRequests[c]);
+		fprintf (fp, "priolatency,%d,%lu\n", c, st.prioLatency[c]);
+		fprintf (fp, "priomaxlatency,%d,%lu\n", c,
+		         st.prioMaxLatency[c]);
+	}
+	for (int b = 0; b < DISK_SEEKHISTBUCKETS; b++)
+		fprintf (fp, "seekhist,%lu,%lu\n",
+		         (b ? 1UL << (b - 1) : 0UL), st.seekHist[b]);
+	for (unsigned long c = 0; c < numHeat; c++)
+		fprintf (fp, "cylinder,%lu,%lu\n", c, heat[c]);
+	if (ferror (fp)) result = -1;
+	if (fclose (fp) != 0) result = -1;
+	free (heat);
+	return result;
 }
 
 //Funcao que escreve em *cyl o numero do cilindro correspondente a um endereco
@@ -120,15 +1993,56 @@ int diskAddrToCylinder (Disk* d, unsigned long addr, unsigned long *cyl) {
 	return (addr < d->numSectors ? 0 : -1);
 }
 
+//Funcao interna que registra no rastreamento do disco, se ligado, uma
+//operacao op sobre count setores contiguos a partir do endereco addr
+void __diskTraceLog(Disk *d, unsigned long addr, unsigned long count,
+                    int op) {
+	unsigned char rec[DISK_TRACERECORDSIZE];
+	struct timespec now;
+	unsigned long usecs, cyl;
+	if (!d->trace) return;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	diskAddrToCylinder (d, addr, &cyl);
+	pthread_mutex_lock (&d->traceLock);
+	if (d->trace) {
+		usecs = (now.tv_sec - d->traceStart.tv_sec) * 1000000UL
+		        + now.tv_nsec / 1000 - d->traceStart.tv_nsec / 1000;
+		__diskPutLE (rec, usecs, 8);
+		__diskPutLE (rec + 8, addr, 8);
+		__diskPutLE (rec + 16, cyl, 4);
+		__diskPutLE (rec + 20, (count & 0x7FFFFFFFUL) |
+		             (op == DISK_OPWRITE ? 0x80000000UL : 0), 4);
+		fwrite (rec, DISK_TRACERECORDSIZE, 1, d->trace);
+	}
+	pthread_mutex_unlock (&d->traceLock);
+}
+
+//Funcao interna que le count setores contiguos, ja validados, pela cache do
+//disco, se ligada, ou diretamente do meio fisico. Discos mapeados em memoria
+//nao usam a cache, pois o ponteiro de diskGetSectorData altera o meio sem
+//passar por ela
+int __diskRead(Disk *d, unsigned long addr, unsigned long count,
+               unsigned char *data) {
+	if (d->cacheCap && !d->map) return __diskCachedRead (d, addr, count, data);
+	return __diskMediaRead (d, addr, count, data);
+}
+
+//Funcao interna que grava count setores contiguos, ja validados, pela cache
+//do disco, se ligada, ou diretamente no meio fisico. Discos mapeados em
+//memoria nao usam a cache
+int __diskWrite(Disk *d, unsigned long addr, unsigned long count,
+                unsigned char *data) {
+	if (d->cacheCap && !d->map) return __diskCachedWrite (d, addr, count, data);
+	return __diskMediaWrite (d, addr, count, data);
+}
+
 //Funcao para realizar a leitura de um setor identificado pelo endereco LBA
 //(addr). Os dados sao transferidos para *data. Retorna 0 se a leitura ocorreu
 //sem erros e -1 caso contrario
 int diskReadSector (Disk* d, unsigned long addr, unsigned char *data) {
 	if (addr >= d->numSectors) return -1;
-	__diskSeek (d,addr);
-	if (fread (data, 1, DISK_SECTORDATASIZE, d->fp) != DISK_SECTORDATASIZE)
-		return -1;
-	return 0;
+	__diskTraceLog (d, addr, 1, DISK_OPREAD);
+	return __diskRead (d, addr, 1, data);
 }
 
 //Funcao para realzar a escrita de um setor identificado pelo endereco LBA
@@ -136,30 +2050,1137 @@ int diskReadSector (Disk* d, unsigned long addr, unsigned char *data) {
 //ocorreu sem erros e -1 caso contrario
 int diskWriteSector (Disk* d, unsigned long addr, unsigned char* data) {
 	if (addr >= d->numSectors) return -1;
-	__diskSeek (d,addr);
-	if (fwrite (data, 1, DISK_SECTORDATASIZE, d->fp) != DISK_SECTORDATASIZE)
-		return -1;
+	__diskTraceLog (d, addr, 1, DISK_OPWRITE);
+	return __diskWrite (d, addr, 1, data);
+}
+
+//Funcao para realizar a leitura de count setores contiguos a partir do
+//endereco LBA addr, com um unico posicionamento e uma unica transferencia.
+//Os dados sao transferidos para *data, que deve comportar
+//count*DISK_SECTORDATASIZE bytes. Retorna 0 se a leitura ocorreu sem erros
+//e -1 caso contrario
+int diskReadSectors (Disk* d, unsigned long addr, unsigned long count,
+                     unsigned char *data) {
+	if (count == 0) return 0;
+	if (addr >= d->numSectors || count > d->numSectors - addr) return -1;
+	__diskTraceLog (d, addr, count, DISK_OPREAD);
+	return __diskRead (d, addr, count, data);
+}
+
+//Funcao para realizar a escrita de count setores contiguos a partir do
+//endereco LBA addr, com um unico posicionamento e uma unica transferencia.
+//Os dados sao transferidos a partir de *data. O enquadramento (preambulo e
+//ECC) entre os setores e' regravado internamente. Retorna 0 se a escrita
+//ocorreu sem erros e -1 caso contrario
+int diskWriteSectors (Disk* d, unsigned long addr, unsigned long count,
+                      unsigned char *data) {
+	if (count == 0) return 0;
+	if (addr >= d->numSectors || count > d->numSectors - addr) return -1;
+	__diskTraceLog (d, addr, count, DISK_OPWRITE);
+	return __diskWrite (d, addr, count, data);
+}
+
+//Funcao que descarta count setores contiguos a partir do endereco LBA addr,
+//que passam a ser lidos como setores em branco, como num disco recem-criado.
+//O espaco correspondente no arquivo do disco e' liberado quando o sistema
+//hospedeiro permite. Copias dos setores na cache sao descartadas sem
+//gravacao. Retorna 0 se bem sucedido e -1 caso contrario
+int diskDiscardSectors (Disk* d, unsigned long addr, unsigned long count) {
+	int result;
+	if (count == 0) return 0;
+	if (addr >= d->numSectors || count > d->numSectors - addr) return -1;
+	pthread_mutex_lock (&d->cacheLock);
+	__diskCacheWaitLoads (d);
+	for (int e = d->cacheHead, next; e >= 0; e = next) {
+		next = d->cache[e].next;
+		if (d->cache[e].addr >= addr && d->cache[e].addr < addr + count)
+			__diskCacheDrop (d, e);
+	}
+	result = __diskMediaDiscard (d, addr, count);
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao que retorna um ponteiro para a area de dados do setor addr dentro
+//do mapeamento em memoria de um disco conectado no modo DISK_MODEMMAP,
+//permitindo acesso sem copia. O custo de posicionamento da cabeca e'
+//contabilizado como numa leitura. Escritas pelo ponteiro sao persistidas no
+//arquivo do disco e vistas pelas leituras seguintes, ja que discos mapeados
+//nao usam a cache de setores, e devem ser declaradas com diskPutSectorData,
+//que atualiza a soma de verificacao. Retorna NULL se o disco nao estiver
+//mapeado ou se o endereco for invalido
+unsigned char* diskGetSectorData (Disk* d, unsigned long addr) {
+	unsigned char *frame;
+	if (!d->map || addr >= d->numSectors) return NULL;
+	__diskTraceLog (d, addr, 1, DISK_OPREAD);
+	__diskAccess (d, addr, 1, DISK_OPREAD);
+	if (d->format == DISK_FORMATALIGNED)
+		return d->map + __diskAlignedPos (addr);
+	frame = __diskMapFrame (d, addr);
+	if (d->verify && __diskFrameCheck (frame) < 0) {
+		pthread_mutex_lock (&d->headLock);
+		d->stats.checksumErrors++;
+		pthread_mutex_unlock (&d->headLock);
+		return NULL;
+	}
+	//Um setor nunca gravado e' materializado em branco
+	if (__diskFrameIsHole (frame)) {
+		unsigned char blank[DISK_SECTORDATASIZE];
+		memset (blank, ' ', DISK_SECTORDATASIZE);
+		__diskFramePut (frame, blank);
+	}
+	return frame + DISK_SECTORDATAOFFSET;
+}
+
+//Funcao que declara a escrita, pelo ponteiro obtido com diskGetSectorData, do
+//setor addr de um disco mapeado em memoria, recalculando a soma de
+//verificacao do setor. Deve ser chamada apos cada alteracao pelo ponteiro e
+//antes de novas leituras do setor. Nao ha custo no relogio simulado. Retorna
+//0 se bem sucedido e -1 se o disco nao estiver mapeado ou se o endereco for
+//invalido
+int diskPutSectorData (Disk* d, unsigned long addr) {
+	unsigned char *frame, *ecc;
+	unsigned int crc;
+	if (!d->map || addr >= d->numSectors) return -1;
+	if (d->format == DISK_FORMATALIGNED) return 0;
+	frame = __diskMapFrame (d, addr);
+	ecc = frame + DISK_SECTORDATAOFFSET + DISK_SECTORDATASIZE;
+	crc = __diskFrameECC (frame + DISK_SECTORDATAOFFSET);
+	ecc[0] = crc & 0xFF;
+	ecc[1] = (crc >> 8) & 0xFF;
+	ecc[2] = (crc >> 16) & 0xFF;
 	return 0;
 }
 
+//Funcao que grava no disco todos os setores modificados que ainda estao
+//apenas na cache. Retorna 0 se bem sucedido e -1 caso contrario
+int diskFlush (Disk* d) {
+	int result;
+	pthread_mutex_lock (&d->cacheLock);
+	result = __diskCacheFlush (d);
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao que redefine a capacidade, em setores, da cache de um disco. Os
+//setores modificados sao gravados e a cache e' esvaziada. Capacidade 0
+//desliga a cache. Discos mapeados em memoria nao usam a cache. Retorna 0 se
+//bem sucedido e -1 caso contrario
+int diskSetCacheCapacity (Disk* d, unsigned int capacity) {
+	int result;
+	pthread_mutex_lock (&d->cacheLock);
+	__diskCacheWaitLoads (d);
+	result = __diskCacheFlush (d);
+	if (result == 0) result = __diskCacheInit (d, capacity);
+	pthread_mutex_unlock (&d->cacheLock);
+	return result;
+}
+
+//Funcao que retorna a capacidade, em setores, da cache de um disco
+unsigned int diskGetCacheCapacity (Disk* d) {
+	unsigned int capacity;
+	pthread_mutex_lock (&d->cacheLock);
+	capacity = d->cacheCap;
+	pthread_mutex_unlock (&d->cacheLock);
+	return capacity;
+}
+
+//Funcao que liga (enabled nao nulo) ou desliga o buffer de trilha de um
+//disco, com as DISK_TRACKSEGMENTS trilhas lidas mais recentemente. Com o
+//buffer ligado, a leitura de setores de uma trilha ausentes do buffer traz
+//tambem os setores seguintes, ate o fim da trilha, e leituras posteriores
+//desses setores sao atendidas da memoria. Num volume virtual, o buffer e'
+//ligado nos membros. Discos mapeados em memoria ficam sempre sem o buffer,
+//pois o ponteiro de diskGetSectorData altera o meio sem passar por ele.
+//Discos sao conectados com o buffer desligado. Retorna 0 se bem sucedido e
+//-1 caso contrario
+int diskSetTrackBuffer (Disk* d, int enabled) {
+	int result = 0;
+	for (unsigned int m = 0; m < d->numMembers; m++)
+		if (diskSetTrackBuffer (d->members[m], enabled) < 0)
+			result = -1;
+	if (d->numMembers || d->map) return result;
+	pthread_mutex_lock (&d->trackLock);
+	if (enabled && !d->track) {
+		d->track = calloc (DISK_TRACKSEGMENTS, 
+		                   sizeof (DiskTrackSegment));
+		if (!d->track) result = -1;
+	}
+	else if (!enabled) {
+		free (d->track);
+		d->track = NULL;
+	}
+	pthread_mutex_unlock (&d->trackLock);
+	return result;
+}
+
+//Funcao que retorna 1 se o buffer de trilha de um disco estiver ligado e 0
+//caso contrario
+int diskGetTrackBuffer (Disk* d) {
+	if (d->numMembers) return diskGetTrackBuffer (d->members[0]);
+	return (d->track != NULL);
+}
+
+//Funcao interna que preenche buf com a formatacao de baixo nivel de um
+//cilindro inteiro: DISK_SECTORSPERTRACK setores com preambulo, dados em
+//branco e ECC. buf deve comportar DISK_CYLINDERSIZE bytes
+void __diskFormatCylinder(unsigned char *buf) {
+	for (int j = 0; j < DISK_SECTORSPERTRACK; j++) {
+		unsigned char *sector = buf + j * DISK_SECTORTOTALSIZE;
+		memcpy (sector, DISK_SECTORPREAMBLE, DISK_SECTORDATAOFFSET);
+		memset (sector + DISK_SECTORDATAOFFSET, ' ', DISK_SECTORDATASIZE);
+		memcpy (sector + DISK_SECTORDATAOFFSET + DISK_SECTORDATASIZE,
+		        DISK_SECTORECC, DISK_SECTORDATAOFFSET);
+	}
+}
+
 //Funcao para a criacao de um disco fisico, a ser representado pelo arquivo
 //regular indicado por rawDiskPath e com numero total de cilindros indicado
 //por numCylinders. Retorna 0 se o disco fisico for criado com sucesso e -1
 //caso contrario. O disco fisico ja eh criado com formatacao de baixo nivel
 int diskCreateRawDisk (char* rawDiskPath, unsigned long numCylinders) {
 	FILE* fp;
+	unsigned char *cylinder;
+	int result = 0;
 	if (numCylinders == 0) return -1;
+	cylinder = malloc (DISK_CYLINDERSIZE);
+	if (cylinder == NULL) return -1;
 	fp = fopen (rawDiskPath, "w+");
-	if (fp == NULL) return -1;
-	for (unsigned long i = 0; i < numCylinders; i++) {
-		for (int j = 0; j < DISK_SECTORSPERTRACK; j++) {
-			fwrite(DISK_SECTORPREAMBLE,1,DISK_SECTORDATAOFFSET,fp);
-			for (int k = 0; k < DISK_SECTORDATASIZE; k++)
-				fwrite(" ",1,1,fp);
-			fwrite(DISK_SECTORECC,1,DISK_SECTORDATAOFFSET,fp);
+	if (fp == NULL) {
+		free (cylinder);
+		return -1;
+	}
+	//Um unico buffer pre-formatado e' gravado uma vez por cilindro
+	__diskFormatCylinder (cylinder);
+	for (unsigned long i = 0; i < numCylinders && result == 0; i++)
+		if (fwrite (cylinder, 1, DISK_CYLINDERSIZE, fp) 
+		    != DISK_CYLINDERSIZE)
+			result = -1;
+	if (fclose(fp) != 0) result = -1;
+	free (cylinder);
+	return result;
+}
+
+//Funcao para a criacao de um disco fisico esparso, com numCylinders
+//cilindros, no arquivo regular rawDiskPath. Nenhum setor e' gravado: o
+//arquivo e' apenas estendido ate o tamanho do disco e seus buracos sao lidos
+//como setores em branco, ocupando espaco no sistema hospedeiro apenas quando
+//gravados. Retorna 0 se o disco fisico for criado com sucesso e -1 caso
+//contrario
+int diskCreateRawDiskSparse (char* rawDiskPath, unsigned long numCylinders) {
+	int fd, result = 0;
+	if (numCylinders == 0) return -1;
+	fd = open (rawDiskPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return -1;
+	if (ftruncate (fd, (off_t) numCylinders * DISK_CYLINDERSIZE) != 0)
+		result = -1;
+	if (close (fd) != 0) result = -1;
+	return result;
+}
+
+//Funcao para a criacao de um disco fisico no formato alinhado
+//(DISK_FORMATALIGNED), com numCylinders cilindros, no arquivo regular
+//rawDiskPath. Os setores, de DISK_SECTORDATASIZE bytes e sem enquadramento,
+//seguem um cabecalho de uma pagina e ficam alinhados a paginas do sistema
+//hospedeiro. Retorna 0 se o disco fisico for criado com sucesso e -1 caso
+//contrario. O disco fisico ja eh criado com setores em branco
+int diskCreateRawDiskAligned (char* rawDiskPath, unsigned long numCylinders) {
+	unsigned char *header, *cylinder;
+	size_t cylSize = DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE;
+	FILE* fp;
+	int result = 0;
+	if (numCylinders == 0) return -1;
+	header = calloc (1, DISK_ALIGNEDHEADERSIZE);
+	cylinder = malloc (cylSize);
+	fp = fopen (rawDiskPath, "w+");
+	if (!header || !cylinder || !fp) result = -1;
+	if (result == 0) {
+		memcpy (header, DISK_ALIGNEDMAGIC, 8);
+		__diskPutLE (header + 8, numCylinders * DISK_SECTORSPERTRACK,
+		             8);
+		memset (cylinder, ' ', cylSize);
+		if (fwrite (header, 1, DISK_ALIGNEDHEADERSIZE, fp)
+		    != DISK_ALIGNEDHEADERSIZE)
+			result = -1;
+	}
+	for (unsigned long i = 0; i < numCylinders && result == 0; i++)
+		if (fwrite (cylinder, 1, cylSize, fp) != cylSize)
+			result = -1;
+	if (fp && fclose (fp) != 0) result = -1;
+	free (cylinder);
+	free (header);
+	return result;
+}
+
+//Funcao que converte o disco fisico do arquivo srcPath, em qualquer
+//formato, para o formato format (DISK_FORMATFRAMED ou DISK_FORMATALIGNED),
+//gravando o resultado no arquivo dstPath, distinto da origem. Setores em
+//branco nao sao copiados; no formato com enquadramento, o destino e' criado
+//esparso. O destino tem o mesmo numero de setores da origem, inclusive os de
+//um cilindro final parcial. Retorna 0 se bem sucedido e -1 caso contrario
+int diskConvertRawDisk (char* srcPath, char* dstPath, int format) {
+	Disk *src, *dst = NULL;
+	unsigned char *buf;
+	unsigned long numCylinders;
+	int result = 0;
+	if (format != DISK_FORMATFRAMED && format != DISK_FORMATALIGNED)
+		return -1;
+	src = diskConnect (0, srcPath);
+	if (!src) return -1;
+	//Um cilindro final parcial e' convertido com seus setores
+	numCylinders = __diskHeatSize (src);
+	buf = malloc (DISK_SECTORSPERTRACK * DISK_SECTORDATASIZE);
+	if (!buf) result = -1;
+	else if (format == DISK_FORMATALIGNED)
+		result = diskCreateRawDiskAligned (dstPath, numCylinders);
+	else
+		result = diskCreateRawDiskSparse (dstPath, numCylinders);
+	if (result == 0 && src->numSectors % DISK_SECTORSPERTRACK != 0)
+		result = __diskTrimRawDisk (dstPath, format, src->numSectors);
+	if (result == 0) dst = diskConnect (1, dstPath);
+	if (!dst) result = -1;
+	else diskSetCacheCapacity (dst, 0);
+	diskSetCacheCapacity (src, 0);
+
+	//Um cilindro por vez, gravando apenas as sequencias nao em branco
+	for (unsigned long c = 0; c < numCylinders && result == 0; c++) {
+		unsigned long first = c * DISK_SECTORSPERTRACK;
+		unsigned long n = src->numSectors - first;
+		if (n > DISK_SECTORSPERTRACK) n = DISK_SECTORSPERTRACK;
+		result = diskReadSectors (src, first, n, buf);
+		for (unsigned long i = 0; i < n && result == 0; ) {
+			unsigned long j = i;
+			while (j < n &&
+			       !__diskIsBlank (buf + j * DISK_SECTORDATASIZE))
+				j++;
+			if (j > i)
+				result = diskWriteSectors (dst, first + i,
+				         j - i, buf + i * DISK_SECTORDATASIZE);
+			i = j + 1;
+		}
+	}
+	if (dst && diskDisconnect (dst) != 0) result = -1;
+	if (diskDisconnect (src) != 0) result = -1;
+	free (buf);
+	return result;
+}
+
+//Faixa de cilindros gravada por uma thread de diskCreateRawDiskParallel
+typedef struct {
+	int fd;				//Descritor do arquivo do disco
+	unsigned long firstCylinder;	//Primeiro cilindro da faixa
+	unsigned long lastCylinder;	//Cilindro seguinte ao ultimo da faixa
+	const unsigned char *cylinder;	//Cilindro pre-formatado
+	int result;			//0 se bem sucedida, -1 caso contrario
+} DiskBuildRange;
+
+//Funcao interna, executada por thread, que grava uma faixa de cilindros
+//pre-formatados com escrita posicional
+void* __diskBuildRange(void *arg) {
+	DiskBuildRange *r = arg;
+	r->result = 0;
+	for (unsigned long i = r->firstCylinder; i < r->lastCylinder; i++) {
+		if (__diskPwrite (r->fd, r->cylinder, DISK_CYLINDERSIZE,
+		                  (off_t) i * DISK_CYLINDERSIZE) < 0) {
+			r->result = -1;
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+//Funcao para a criacao de um disco fisico como diskCreateRawDisk, dividindo
+//os cilindros em faixas disjuntas gravadas em paralelo por numThreads
+//threads. O arquivo resultante e' identico ao de diskCreateRawDisk. Retorna 0
+//se o disco fisico for criado com sucesso e -1 caso contrario
+int diskCreateRawDiskParallel (char* rawDiskPath, unsigned long numCylinders,
+                               unsigned int numThreads) {
+	unsigned char *cylinder;
+	DiskBuildRange *ranges;
+	pthread_t *threads;
+	unsigned long perThread;
+	unsigned int started = 0;
+	int fd, result = 0;
+	if (numCylinders == 0) return -1;
+	if (numThreads > numCylinders) numThreads = numCylinders;
+	if (numThreads <= 1) return diskCreateRawDisk (rawDiskPath, numCylinders);
+
+	fd = open (rawDiskPath, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) return -1;
+	if (ftruncate (fd, (off_t) numCylinders * DISK_CYLINDERSIZE) != 0) {
+		close (fd);
+		return -1;
+	}
+	cylinder = malloc (DISK_CYLINDERSIZE);
+	ranges = malloc (numThreads * sizeof (DiskBuildRange));
+	threads = malloc (numThreads * sizeof (pthread_t));
+	if (!cylinder || !ranges || !threads) {
+		free (cylinder); free (ranges); free (threads);
+		close (fd);
+		return -1;
+	}
+	__diskFormatCylinder (cylinder);
+
+	perThread = (numCylinders + numThreads - 1) / numThreads;
+	for (unsigned int t = 0; t < numThreads; t++) {
+		ranges[t].fd = fd;
+		ranges[t].cylinder = cylinder;
+		ranges[t].firstCylinder = t * perThread;
+		ranges[t].lastCylinder = (t + 1) * perThread;
+		if (ranges[t].lastCylinder > numCylinders)
+			ranges[t].lastCylinder = numCylinders;
+		if (pthread_create (&threads[t], NULL, __diskBuildRange,
+		                    &ranges[t]) != 0) {
+			result = -1;
+			break;
+		}
+		started++;
+	}
+	for (unsigned int t = 0; t < started; t++) {
+		pthread_join (threads[t], NULL);
+		if (ranges[t].result != 0) result = -1;
+	}
+
+	if (close (fd) != 0) result = -1;
+	free (cylinder); free (ranges); free (threads);
+	return result;
+}
+
+//Funcao interna que compara entradas da fila na ordem C-LOOK: primeiro os
+//setores a frente da cabeca em ordem crescente, depois os que ficaram atras
+int __diskQueueCompare(const void *a, const void *b) {
+	const DiskQueueEntry *x = a, *y = b;
+	if (x->wrap != y->wrap) return x->wrap - y->wrap;
+	if (x->addr != y->addr) return (x->addr < y->addr ? -1 : 1);
+	return (x->seq < y->seq ? -1 : (x->seq > y->seq));
+}
+
+//Funcao interna que atende uma sequencia de count requisicoes de mesma
+//operacao sobre setores contiguos, com uma unica transferencia
+int __diskQueueServeRun(Disk *d, DiskQueueEntry *run, unsigned int count) {
+	unsigned char *buf;
+	int ret;
+	if (count == 1) {
+		DiskRequest *r = run[0].req;
+		return (r->op == DISK_OPWRITE
+		        ? diskWriteSector (d, r->addr, r->data)
+		        : diskReadSector (d, r->addr, r->data));
+	}
+	buf = malloc (count * DISK_SECTORDATASIZE);
+	if (!buf) return -1;
+	if (run[0].req->op == DISK_OPWRITE) {
+		for (unsigned int i = 0; i < count; i++)
+			memcpy (buf + i * DISK_SECTORDATASIZE,
+			        run[i].req->data, DISK_SECTORDATASIZE);
+		ret = diskWriteSectors (d, run[0].addr, count, buf);
+	}
+	else {
+		ret = diskReadSectors (d, run[0].addr, count, buf);
+		if (ret == 0)
+			for (unsigned int i = 0; i < count; i++)
+				memcpy (run[i].req->data,
+				        buf + i * DISK_SECTORDATASIZE,
+				        DISK_SECTORDATASIZE);
+	}
+	free (buf);
+	return ret;
+}
+
+//Funcao que enfileira um lote de n requisicoes de setor no disco d, sem
+//atende-las. As requisicoes devem permanecer validas ate o atendimento por
+//diskQueueDispatch. Retorna 0 se bem sucedido ou -1 caso contrario
+int diskQueueSubmit (Disk *d, DiskRequest *reqs, unsigned int n) {
+	if (!d || (!reqs && n)) return -1;
+	pthread_mutex_lock (&d->queueLock);
+	if (d->queueLen + n > d->queueCap) {
+		unsigned int cap = (d->queueCap ? d->queueCap : 64);
+		DiskRequest **q;
+		while (cap < d->queueLen + n) cap *= 2;
+		q = realloc (d->queue, cap * sizeof (DiskRequest*));
+		if (!q) {
+			pthread_mutex_unlock (&d->queueLock);
+			return -1;
+		}
+		d->queue = q;
+		d->queueCap = cap;
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		reqs[i].result = -1;
+		reqs[i].submitTime = diskGetElapsedSimTime (d);
+		d->queue[d->queueLen++] = &reqs[i];
+	}
+	pthread_mutex_unlock (&d->queueLock);
+	return 0;
+}
+
+//Funcao que escolhe o algoritmo de escalonamento da fila do disco d:
+//DISK_SCHEDCLOOK ou DISK_SCHEDSPTF, que atende primeiro a requisicao de
+//menor tempo de posicionamento (deslocamento e espera rotacional) segundo o
+//modelo de latencia do disco. Discos sao conectados com DISK_SCHEDCLOOK.
+//Retorna 0 se bem sucedido e -1 caso contrario
+int diskSetScheduler (Disk *d, int sched) {
+	if (!d || (sched != DISK_SCHEDCLOOK && sched != DISK_SCHEDSPTF))
+		return -1;
+	pthread_mutex_lock (&d->queueLock);
+	d->sched = sched;
+	pthread_mutex_unlock (&d->queueLock);
+	return 0;
+}
+
+//Funcao que retorna o algoritmo de escalonamento da fila do disco d
+int diskGetScheduler (Disk *d) {
+	int sched;
+	pthread_mutex_lock (&d->queueLock);
+	sched = d->sched;
+	pthread_mutex_unlock (&d->queueLock);
+	return sched;
+}
+
+//Funcao interna que reordena as n entradas e pelo algoritmo SPTF segundo o
+//modelo m: a partir da cabeca no cilindro *cyl no instante *now, escolhe
+//repetidamente a entrada de menor tempo de posicionamento e avanca a posicao
+//e o relogio estimados pelo atendimento dela, deixando-os em *cyl e *now.
+//Empates preservam a ordem de chegada
+void __diskQueueOrderSPTF(const DiskLatencyModel *m, DiskQueueEntry *e,
+                          unsigned int n, unsigned long *cyl,
+                          unsigned long *now) {
+	unsigned long xfer = __diskTransferTime (m);
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int best = i;
+		unsigned long bestTime = __diskPositionTime (m, *cyl, *now,
+		                                             e[i].addr);
+		DiskQueueEntry tmp;
+		for (unsigned int j = i + 1; j < n; j++) {
+			unsigned long t = __diskPositionTime (m, *cyl, *now,
+			                                      e[j].addr);
+			if (t < bestTime || (t == bestTime && e[j].seq < e[best].seq)) {
+				best = j;
+				bestTime = t;
+			}
+		}
+		tmp = e[i];
+		e[i] = e[best];
+		e[best] = tmp;
+		*now += bestTime + xfer;
+		*cyl = e[i].addr / DISK_SECTORSPERTRACK;
+	}
+}
+
+//Funcao interna que compara entradas da fila por classe efetiva e, dentro da
+//classe, por ordem de chegada
+int __diskQueueComparePrio(const void *a, const void *b) {
+	const DiskQueueEntry *x = a, *y = b;
+	if (x->prio != y->prio) return x->prio - y->prio;
+	return (x->seq < y->seq ? -1 : (x->seq > y->seq));
+}
+
+//Funcao interna que atende requisicoes dentre as count de reqs, ja
+//retiradas da fila do disco d, como diskQueueDispatch: por classe efetiva e,
+//dentro de cada classe, na ordem do escalonador, continuando da posicao
+//estimada da cabeca ao fim da classe anterior. Se bgLimit nao for nulo, sao
+//atendidas de DISK_PRIOBACKGROUND apenas a primeira requisicao e as que
+//formam com ela uma unica transferencia de ate bgLimit setores. reqs e'
+//reordenado com as *served requisicoes concluidas no inicio e as demais,
+//ainda pendentes, ao final. Retorna o numero de requisicoes mal sucedidas ou
+//-1 em caso de falha
+int __diskQueueServe(Disk *d, DiskRequest **reqs, unsigned int count,
+                     unsigned long bgLimit, unsigned int *served) {
+	DiskQueueEntry *e;
+	DiskLatencyModel m;
+	unsigned long cyl, prev, head, now, fcfs = 0, sched = 0, bg = 0;
+	unsigned long *arrival;
+	unsigned int n = 0, k = 0, take, failed = 0;
+	*served = 0;
+	e = malloc (count * sizeof (DiskQueueEntry));
+	arrival = calloc (count, sizeof (unsigned long));
+	if (!e || !arrival) {
+		free (e);
+		free (arrival);
+		return -1;
+	}
+
+	pthread_mutex_lock (&d->queueLock);
+	pthread_mutex_lock (&d->headLock);
+	m = d->model;
+	head = d->currCylinder;
+	now = d->simTime;
+	pthread_mutex_unlock (&d->headLock);
+	//Requisicoes invalidas sao concluidas de imediato, no inicio de reqs
+	for (unsigned int i = 0; i < count; i++) {
+		DiskRequest *r = reqs[i];
+		if (diskAddrToCylinder (d, r->addr, &cyl) < 0 || !r->data) {
+			reqs[k++] = r;
+			failed++;
+			continue;
+		}
+		e[n].prio = (r->prio > DISK_PRIOSYNC && r->prio < DISK_PRIOCLASSES
+		             ? r->prio : DISK_PRIOSYNC);
+		if (e[n].prio != DISK_PRIOSYNC && d->prioAgeLimit &&
+		    now > r->submitTime && now - r->submitTime > d->prioAgeLimit) {
+			e[n].prio = DISK_PRIOSYNC;
+			pthread_mutex_lock (&d->headLock);
+			d->stats.prioPromoted++;
+			pthread_mutex_unlock (&d->headLock);
+		}
+		e[n].addr = r->addr;
+		e[n].seq = i;
+		e[n].req = r;
+		n++;
+	}
+	qsort (e, n, sizeof (DiskQueueEntry), __diskQueueComparePrio);
+	cyl = head;
+	for (unsigned int i = 0, j; i < n; i = j) {
+		for (j = i; j < n && e[j].prio == e[i].prio; j++)
+			e[j].wrap = (e[j].addr / DISK_SECTORSPERTRACK < cyl);
+		if (d->sched == DISK_SCHEDSPTF)
+			__diskQueueOrderSPTF (&m, &e[i], j - i, &cyl, &now);
+		else {
+			qsort (&e[i], j - i, sizeof (DiskQueueEntry),
+			       __diskQueueCompare);
+			cyl = e[j-1].addr / DISK_SECTORSPERTRACK;
+		}
+	}
+	prev = head;
+	//Segundo plano limitado a uma transferencia de ate bgLimit setores
+	for (take = 0; take < n; take++) {
+		if (e[take].prio != DISK_PRIOBACKGROUND) continue;
+		if (bgLimit && bg && (bg >= bgLimit ||
+		    e[take].req->op != e[take-1].req->op ||
+		    e[take].addr != e[take-1].addr + 1))
+			break;
+		bg++;
+	}
+
+	//Percursos das atendidas na ordem escolhida e na ordem de chegada
+	for (unsigned int i = 0; i < take; i++) {
+		cyl = e[i].addr / DISK_SECTORSPERTRACK;
+		sched += (cyl < prev ? prev - cyl : cyl - prev);
+		prev = cyl;
+		arrival[e[i].seq] = cyl + 1;
+	}
+	prev = head;
+	for (unsigned int i = 0; i < count; i++) {
+		if (!arrival[i]) continue;
+		cyl = arrival[i] - 1;
+		fcfs += (cyl < prev ? prev - cyl : cyl - prev);
+		prev = cyl;
+	}
+	d->seekFCFS += fcfs;
+	d->seekSched += sched;
+	pthread_mutex_unlock (&d->queueLock);
+
+	for (unsigned int i = 0; i < take; ) {
+		unsigned int j = i + 1;
+		unsigned long done;
+		int ret;
+		while (j < take && e[j].req->op == e[i].req->op
+		       && e[j].addr == e[j-1].addr + 1)
+			j++;
+		ret = __diskQueueServeRun (d, &e[i], j - i);
+		done = diskGetElapsedSimTime (d);
+		pthread_mutex_lock (&d->headLock);
+		for (; i < j; i++) {
+			DiskRequest *r = e[i].req;
+			int c = (r->prio > DISK_PRIOSYNC && r->prio < DISK_PRIOCLASSES
+			         ? r->prio : DISK_PRIOSYNC);
+			unsigned long lat = (done > r->submitTime 
+			                     ? done - r->submitTime : 0);
+			r->result = (ret < 0 ? -1 : 0);
+			if (ret < 0) failed++;
+			d->stats.prioRequests[c]++;
+			d->stats.prioLatency[c] += lat;
+			if (lat > d->stats.prioMaxLatency[c])
+				d->stats.prioMaxLatency[c] = lat;
+		}
+		pthread_mutex_unlock (&d->headLock);
+	}
+	for (unsigned int i = 0; i < n; i++)
+		reqs[k + i] = e[i].req;
+	*served = k + take;
+	free (e);
+	free (arrival);
+	return (int) failed;
+}
+
+//Funcao que atende todas as requisicoes pendentes na fila do disco d, por
+//classe de prioridade e, dentro de cada classe, na ordem do algoritmo de
+//escalonamento do disco (C-LOOK a partir do cilindro atual ou SPTF a partir
+//da posicao atual da cabeca). Requisicoes que esperaram mais que o limite de
+//espera do disco sao promovidas a DISK_PRIOSYNC. Requisicoes de mesma
+//operacao sobre setores adjacentes sao agrupadas numa unica transferencia.
+//O resultado de cada requisicao e' escrito em seu campo result. Retorna o
+//numero de requisicoes mal sucedidas ou -1 em caso de falha
+int diskQueueDispatch (Disk *d) {
+	DiskRequest **reqs;
+	unsigned int n, served;
+	int result = 0;
+	if (!d) return -1;
+	//A fila e' esvaziada de uma vez: novas requisicoes formam outro lote
+	pthread_mutex_lock (&d->queueLock);
+	reqs = d->queue;
+	n = d->queueLen;
+	d->queue = NULL;
+	d->queueLen = d->queueCap = 0;
+	pthread_mutex_unlock (&d->queueLock);
+	if (n) result = __diskQueueServe (d, reqs, n, 0, &served);
+	free (reqs);
+	return result;
+}
+
+//Funcao que define o limite de espera, em us do relogio simulado, das
+//requisicoes enfileiradas no disco d: uma requisicao de classe DISK_PRIOASYNC
+//ou DISK_PRIOBACKGROUND que espere mais que limit e' atendida como
+//DISK_PRIOSYNC. Limite 0 desliga a promocao. Discos sao conectados com
+//limite de 1 s
+void diskSetPriorityAgeLimit (Disk *d, unsigned long limit) {
+	pthread_mutex_lock (&d->queueLock);
+	d->prioAgeLimit = limit;
+	pthread_mutex_unlock (&d->queueLock);
+}
+
+//Funcao que retorna o limite de espera, em us, das requisicoes enfileiradas
+//no disco d
+unsigned long diskGetPriorityAgeLimit (Disk *d) {
+	unsigned long limit;
+	pthread_mutex_lock (&d->queueLock);
+	limit = d->prioAgeLimit;
+	pthread_mutex_unlock (&d->queueLock);
+	return limit;
+}
+
+//Funcao que retorna quantos cilindros de deslocamento o escalonador
+//economizou, desde a conexao do disco, em relacao ao atendimento das mesmas
+//requisicoes em ordem de chegada. Pode ser negativo
+long diskQueueGetSeekSaved (Disk *d) {
+	long saved;
+	pthread_mutex_lock (&d->queueLock);
+	saved = (long) d->seekFCFS - (long) d->seekSched;
+	pthread_mutex_unlock (&d->queueLock);
+	return saved;
+}
+
+//Funcao interna executada pela thread trabalhadora da E/S assincrona de um
+//disco: junta as requisicoes do anel de submissao as ainda pendentes,
+//atende-as como um lote do escalonador, com uma unica transferencia de ate
+//DISK_PRIOBGSLICE setores de segundo plano, e coloca as concluidas no anel
+//de conclusao. As pendentes voltam a concorrer com as novas submissoes. Ao
+//parar, as requisicoes ja submetidas sao atendidas antes
+void* __diskAsyncWorker(void *arg) {
+	Disk *d = arg;
+	DiskRequest **batch = d->asyncBatch;
+	unsigned int pending = 0;
+	pthread_mutex_lock (&d->asyncLock);
+	for (;;) {
+		unsigned int served;
+		while (!d->sqLen && !pending && !d->asyncStop)
+			pthread_cond_wait (&d->asyncSubmitted, &d->asyncLock);
+		if (!d->sqLen && !pending) break;
+		//Ha' espaco: o lote comporta todas em voo
+		while (d->sqLen) {
+			batch[pending++] = d->asyncSQ[d->sqHead];
+			d->sqHead = (d->sqHead + 1) % d->asyncDepth;
+			d->sqLen--;
+		}
+		pthread_mutex_unlock (&d->asyncLock);
+		//Sem memoria para o lote, as requisicoes sao atendidas uma a uma
+		if (__diskQueueServe (d, batch, pending, DISK_PRIOBGSLICE,
+		                      &served) < 0) {
+			for (unsigned int i = 0; i < pending; i++)
+				__diskQueueServe (d, &batch[i], 1, 0, &served);
+			served = pending;
 		}
-//		fflush(stdout);
+		pthread_mutex_lock (&d->asyncLock);
+		for (unsigned int i = 0; i < served; i++) {
+			d->asyncCQ[(d->cqHead + d->cqLen) % d->asyncDepth] = batch[i];
+			d->cqLen++;
+		}
+		pending -= served;
+		memmove (batch, batch + served, pending * sizeof (DiskRequest*));
+		if (served) pthread_cond_broadcast (&d->asyncCompleted);
+	}
+	pthread_mutex_unlock (&d->asyncLock);
+	return NULL;
+}
+
+//Funcao que liga a E/S assincrona do disco d, com aneis de submissao e de
+//conclusao de depth requisicoes e uma thread trabalhadora que atende as
+//submissoes em lotes, como diskQueueDispatch. A cada lote, as requisicoes de
+//classe DISK_PRIOBACKGROUND atendidas formam uma unica transferencia de ate
+//uma trilha, de modo que novas requisicoes de primeiro plano esperem no
+//maximo essa transferencia.
+//Retorna 0 se bem sucedido e -1 caso contrario, inclusive se ja estiver
+//ligada
+int diskAsyncStart (Disk *d, unsigned int depth) {
+	int result = 0;
+	if (!d || depth == 0) return -1;
+	pthread_mutex_lock (&d->asyncLock);
+	if (d->asyncSQ) result = -1;
+	else {
+		d->asyncSQ = malloc (depth * sizeof (DiskRequest*));
+		d->asyncCQ = malloc (depth * sizeof (DiskRequest*));
+		d->asyncBatch = malloc (depth * sizeof (DiskRequest*));
+		d->asyncDepth = depth;
+		d->sqHead = d->sqLen = d->cqHead = d->cqLen = 0;
+		d->asyncInFlight = 0;
+		d->asyncStop = 0;
+		if (!d->asyncSQ || !d->asyncCQ || !d->asyncBatch ||
+		    pthread_create (&d->asyncWorker, NULL, __diskAsyncWorker,
+		                    d) != 0) {
+			free (d->asyncSQ);
+			free (d->asyncCQ);
+			free (d->asyncBatch);
+			d->asyncSQ = d->asyncCQ = d->asyncBatch = NULL;
+			result = -1;
+		}
+	}
+	pthread_mutex_unlock (&d->asyncLock);
+	return result;
+}
+
+//Funcao que submete, sem bloquear, ate n requisicoes de setor do vetor reqs
+//a E/S assincrona do disco d. As requisicoes devem permanecer validas ate
+//serem colhidas por diskAsyncReap. Retorna quantas requisicoes, do inicio de
+//reqs, foram submetidas (menos que n se o anel estiver cheio) ou -1 se a E/S
+//assincrona nao estiver ligada
+int diskAsyncSubmit (Disk *d, DiskRequest *reqs, unsigned int n) {
+	unsigned int i;
+	if (!d || (!reqs && n)) return -1;
+	pthread_mutex_lock (&d->asyncLock);
+	if (!d->asyncSQ || d->asyncStop) {
+		pthread_mutex_unlock (&d->asyncLock);
+		return -1;
+	}
+	for (i = 0; i < n && d->asyncInFlight < d->asyncDepth; i++) {
+		reqs[i].result = -1;
+		reqs[i].submitTime = diskGetElapsedSimTime (d);
+		d->asyncSQ[(d->sqHead + d->sqLen) % d->asyncDepth] = &reqs[i];
+		d->sqLen++;
+		d->asyncInFlight++;
+	}
+	if (i) pthread_cond_signal (&d->asyncSubmitted);
+	pthread_mutex_unlock (&d->asyncLock);
+	return (int) i;
+}
+
+//Funcao que colhe ate max requisicoes concluidas da E/S assincrona do disco
+//d, escrevendo seus enderecos em done, na ordem de conclusao. O resultado de
+//cada uma esta' em seu campo result. Se wait nao for nulo e houver
+//requisicoes em voo, bloqueia ate que ao menos uma seja concluida. Retorna o
+//numero de requisicoes colhidas ou -1 se a E/S assincrona nao estiver ligada
+int diskAsyncReap (Disk *d, DiskRequest **done, unsigned int max, int wait) {
+	unsigned int n = 0;
+	if (!d || (!done && max)) return -1;
+	pthread_mutex_lock (&d->asyncLock);
+	if (!d->asyncSQ) {
+		pthread_mutex_unlock (&d->asyncLock);
+		return -1;
+	}
+	while (wait && max && !d->cqLen && d->asyncInFlight)
+		pthread_cond_wait (&d->asyncCompleted, &d->asyncLock);
+	for (; n < max && d->cqLen; n++) {
+		done[n] = d->asyncCQ[d->cqHead];
+		d->cqHead = (d->cqHead + 1) % d->asyncDepth;
+		d->cqLen--;
+		d->asyncInFlight--;
 	}
-	fclose(fp);
+	pthread_mutex_unlock (&d->asyncLock);
+	return (int) n;
+}
+
+//Funcao que desliga a E/S assincrona do disco d. As requisicoes ja
+//submetidas sao atendidas antes e as conclusoes nao colhidas sao descartadas.
+//Chamada tambem por diskDisconnect. Retorna 0 se bem sucedido e -1 caso
+//contrario
+int diskAsyncStop (Disk *d) {
+	int result = 0;
+	if (!d) return -1;
+	pthread_mutex_lock (&d->asyncLock);
+	if (!d->asyncSQ) {
+		pthread_mutex_unlock (&d->asyncLock);
+		return 0;
+	}
+	d->asyncStop = 1;
+	pthread_cond_signal (&d->asyncSubmitted);
+	pthread_mutex_unlock (&d->asyncLock);
+	if (pthread_join (d->asyncWorker, NULL) != 0) result = -1;
+	pthread_mutex_lock (&d->asyncLock);
+	free (d->asyncSQ);
+	free (d->asyncCQ);
+	free (d->asyncBatch);
+	d->asyncSQ = d->asyncCQ = d->asyncBatch = NULL;
+	d->asyncDepth = d->sqLen = d->cqLen = d->asyncInFlight = 0;
+	//Quem esperava conclusoes volta sem elas
+	pthread_cond_broadcast (&d->asyncCompleted);
+	pthread_mutex_unlock (&d->asyncLock);
+	return result;
+}
+
+//Funcao que liga o rastreamento de E/S de um disco, registrando no arquivo
+//binario tracePath cada leitura e escrita de setores pedida ao disco: instante
+//em microssegundos desde o inicio do rastreamento, endereco LBA, cilindro,
+//numero de setores e operacao. Um rastreamento anterior e' encerrado. Retorna
+//0 se bem sucedido e -1 caso contrario
+int diskTraceStart (Disk *d, char *tracePath) {
+	unsigned char header[DISK_TRACEHEADERSIZE];
+	FILE *fp;
+	if (diskTraceStop (d) != 0) return -1;
+	fp = fopen (tracePath, "wb");
+	if (!fp) return -1;
+	memcpy (header, DISK_TRACEMAGIC, 8);
+	__diskPutLE (header + 8, d->numSectors, 8);
+	if (fwrite (header, DISK_TRACEHEADERSIZE, 1, fp) != 1) {
+		fclose (fp);
+		return -1;
+	}
+	pthread_mutex_lock (&d->traceLock);
+	clock_gettime (CLOCK_MONOTONIC, &d->traceStart);
+	d->trace = fp;
+	pthread_mutex_unlock (&d->traceLock);
 	return 0;
 }
+
+//Funcao que encerra o rastreamento de E/S de um disco, se ligado, fechando o
+//arquivo de rastreamento. Retorna 0 se bem sucedido e -1 caso contrario
+int diskTraceStop (Disk *d) {
+	FILE *fp;
+	int result = 0;
+	pthread_mutex_lock (&d->traceLock);
+	fp = d->trace;
+	d->trace = NULL;
+	pthread_mutex_unlock (&d->traceLock);
+	if (!fp) return 0;
+	if (ferror (fp)) result = -1;
+	if (fclose (fp) != 0) result = -1;
+	return result;
+}
+
+//Funcao interna que atende pelo escalonador do disco as n requisicoes de
+//reqs, apontando seus dados para pool. Retorna o numero de requisicoes mal
+//sucedidas
+unsigned long __diskReplayBatch(Disk *d, DiskRequest *reqs, unsigned int n,
+                                unsigned char *pool) {
+	int failed;
+	for (unsigned int i = 0; i < n; i++)
+		reqs[i].data = pool + (size_t) i * DISK_SECTORDATASIZE;
+	if (diskQueueSubmit (d, reqs, n) < 0) return n;
+	failed = diskQueueDispatch (d);
+	return (failed < 0 ? n : (unsigned long) failed);
+}
+
+//Funcao que reproduz sobre o disco d as operacoes gravadas no arquivo de
+//rastreamento tracePath, na configuracao atual do disco (cache, relogio). Com
+//batch 0, as operacoes sao atendidas em ordem de chegada; caso contrario, sao
+//agrupadas em lotes de ate batch setores (ou uma unica operacao maior),
+//atendidos pelo escalonador configurado no disco (C-LOOK ou SPTF). As
+//escritas gravam setores zerados, portanto a reproducao deve ser feita sobre
+//uma copia do disco. Os setores modificados na cache sao gravados ao final. O
+//resultado e' escrito em *result. Retorna 0 se bem sucedido e -1 se o
+//rastreamento nao puder ser lido
+int diskTraceReplay (Disk *d, char *tracePath, unsigned int batch,
+                     DiskReplayResult *result) {
+	unsigned char rec[DISK_TRACERECORDSIZE];
+	unsigned char *buf = NULL;
+	DiskRequest *reqs = NULL;
+	unsigned long bufCap = 0, pending = 0, start;
+	FILE *fp;
+	int ret = 0;
+
+	memset (result, 0, sizeof (DiskReplayResult));
+	fp = fopen (tracePath, "rb");
+	if (!fp) return -1;
+	if (fread (rec, DISK_TRACEHEADERSIZE, 1, fp) != 1 ||
+	    memcmp (rec, DISK_TRACEMAGIC, 8) != 0) {
+		fclose (fp);
+		return -1;
+	}
+	start = diskGetElapsedSimTime (d);
+
+	while (fread (rec, DISK_TRACERECORDSIZE, 1, fp) == 1) {
+		unsigned long addr = __diskGetLE (rec + 8, 8);
+		unsigned long count = __diskGetLE (rec + 20, 4);
+		int op = (count & 0x80000000UL ? DISK_OPWRITE : DISK_OPREAD);
+		unsigned long need;
+		count &= 0x7FFFFFFFUL;
+		result->requests++;
+		result->sectors += count;
+		result->traceTime = __diskGetLE (rec, 8);
+		if (count == 0) continue;
+		if (count > d->numSectors) {
+			result->failed += count;
+			continue;
+		}
+
+		//O lote pendente e' atendido antes de exceder batch setores
+		if (batch && pending && pending + count > batch) {
+			result->failed += __diskReplayBatch (d, reqs, pending,
+			                                     buf);
+			pending = 0;
+		}
+
+		//Espaco para os dados da operacao e do lote pendente
+		need = (batch ? pending + count : count);
+		if (need > bufCap) {
+			unsigned char *nb;
+			DiskRequest *nr = NULL;
+			nb = realloc (buf, need * DISK_SECTORDATASIZE);
+			if (nb) {
+				buf = nb;
+				nr = realloc (reqs, need * sizeof (DiskRequest));
+			}
+			if (!nr) {
+				ret = -1;
+				break;
+			}
+			reqs = nr;
+			bufCap = need;
+		}
+
+		//Escritas gravam setores zerados, e nao o que leituras anteriores
+		//deixaram no buffer
+		if (op == DISK_OPWRITE)
+			memset (buf + (batch ? pending : 0) * DISK_SECTORDATASIZE, 0,
+			        count * DISK_SECTORDATASIZE);
+
+		if (!batch) {
+			int r = (op == DISK_OPWRITE
+			         ? diskWriteSectors (d, addr, count, buf)
+			         : diskReadSectors (d, addr, count, buf));
+			if (r < 0) result->failed += count;
+			continue;
+		}
+		for (unsigned long i = 0; i < count; i++) {
+			reqs[pending].addr = addr + i;
+			reqs[pending].op = op;
+			reqs[pending].prio = DISK_PRIOSYNC;
+			pending++;
+		}
+		if (pending >= batch) {
+			result->failed += __diskReplayBatch (d, reqs, pending,
+			                                     buf);
+			pending = 0;
+		}
+	}
+	if (pending)
+		result->failed += __diskReplayBatch (d, reqs, pending, buf);
+	if (ferror (fp)) ret = -1;
+	fclose (fp);
+	if (diskFlush (d) < 0) ret = -1;
+	result->simTime = diskGetElapsedSimTime (d) - start;
+	free (reqs);
+	free (buf);
+	return ret;
+}
+
+//Funcao interna que traduz o setor maddr do membro m de um volume
+//distribuido para o setor correspondente do volume
+unsigned long __diskStripeUnmap(Disk *d, unsigned int m, unsigned long maddr) {
+	unsigned long stripe = maddr / d->stripeUnit;
+	return (stripe * d->numMembers + m) * d->stripeUnit
+	       + maddr % d->stripeUnit;
+}
+
+//Funcao interna que verifica as somas de count setores de um disco fisico,
+//ja validados, a partir de addr, um cilindro por vez. Ate maxBad enderecos
+//de setores com soma incorreta sao escritos em bad. Retorna o numero de
+//setores com soma incorreta ou -1 em caso de falha
+long __diskScrubMedia(Disk *d, unsigned long addr, unsigned long count,
+                      unsigned long *bad, unsigned long maxBad) {
+	unsigned char *frames = NULL;
+	long numBad = 0;
+	if (d->format == DISK_FORMATALIGNED) return 0;
+	if (!d->map) {
+		frames = malloc (DISK_CYLINDERSIZE);
+		if (!frames) return -1;
+	}
+	for (unsigned long a = addr; a < addr + count; ) {
+		unsigned long n = DISK_SECTORSPERTRACK - a % DISK_SECTORSPERTRACK;
+		unsigned char *f = frames;
+		if (n > addr + count - a) n = addr + count - a;
+		__diskAccess (d, a, n, DISK_OPREAD);
+		if (d->map) f = __diskMapFrame (d, a);
+		else if (__diskPread (d->fd, frames, n * DISK_SECTORTOTALSIZE,
+		                      __diskFramePos (a)) < 0) {
+			free (frames);
+			return -1;
+		}
+		for (unsigned long i = 0; i < n; i++) {
+			if (__diskFrameCheck (f + i * DISK_SECTORTOTALSIZE) == 0)
+				continue;
+			if (bad && (unsigned long) numBad < maxBad)
+				bad[numBad] = a + i;
+			numBad++;
+		}
+		a += n;
+	}
+	free (frames);
+	if (numBad) {
+		pthread_mutex_lock (&d->headLock);
+		d->stats.checksumErrors += numBad;
+		pthread_mutex_unlock (&d->headLock);
+	}
+	return numBad;
+}
+
+//Funcao que verifica as somas CRC32C de count setores a partir do endereco
+//LBA addr, lendo-os diretamente do meio fisico, independentemente da cache e
+//da verificacao na leitura. Ate maxBad enderecos de setores com soma
+//incorreta sao escritos em bad, que pode ser NULL. Pode ser chamada por uma
+//thread em segundo plano, concorrentemente com as demais operacoes sobre o
+//disco. Setores de discos no formato alinhado nao tem somas. Numa
+//sobreposicao, o delta e a base sao verificados; num volume espelhado, todos
+//os membros. Retorna o numero de setores com soma incorreta ou -1 em caso de
+//falha
+long diskScrub (Disk* d, unsigned long addr, unsigned long count,
+                unsigned long *bad, unsigned long maxBad) {
+	unsigned long *lo, *hi, *mbad = NULL;
+	long numBad = 0;
+	if (count == 0) return 0;
+	if (addr >= d->numSectors || count > d->numSectors - addr) return -1;
+	if (d->kind == DISK_KINDOVERLAY || d->kind == DISK_KINDMIRROR) {
+		//Cada membro e' verificado por inteiro na faixa, inclusive
+		//setores da base encobertos pelo delta de uma sobreposicao. Um
+		//setor danificado em varios membros e' relatado uma vez por membro
+		for (unsigned int m = 0; m < d->numMembers && numBad >= 0; m++) {
+			unsigned long room = ((unsigned long) numBad < maxBad
+			                      ? maxBad - numBad : 0);
+			long n = diskScrub (d->members[m], addr, count,
+			                    (bad && room ? bad + numBad : NULL),
+			                    room);
+			numBad = (n < 0 ? -1 : numBad + n);
+		}
+		return numBad;
+	}
+	if (d->kind != DISK_KINDSTRIPE)
+		return __diskScrubMedia (d, addr, count, bad, maxBad);
+
+	//Cada membro verifica a faixa contigua que lhe cabe
+	lo = calloc (d->numMembers, sizeof (unsigned long));
+	hi = calloc (d->numMembers, sizeof (unsigned long));
+	if (bad && maxBad) mbad = malloc (maxBad * sizeof (unsigned long));
+	if (!lo || !hi || (bad && maxBad && !mbad)) numBad = -1;
+	for (unsigned long a = addr; a < addr + count && numBad == 0; ) {
+		unsigned int m;
+		unsigned long maddr, len;
+		__diskStripeMap (d, a, addr + count, &m, &maddr, &len);
+		if (hi[m] == lo[m]) lo[m] = maddr;
+		hi[m] = maddr + len;
+		a += len;
+	}
+	for (unsigned int m = 0; m < d->numMembers && numBad >= 0; m++) {
+		long n;
+		if (hi[m] == lo[m]) continue;
+		n = diskScrub (d->members[m], lo[m], hi[m] - lo[m], mbad,
+		               maxBad);
+		if (n < 0) {
+			numBad = -1;
+			break;
+		}
+		for (long i = 0; i < n && mbad && i < (long) maxBad; i++)
+			if ((unsigned long) numBad + i < maxBad)
+				bad[numBad + i] = __diskStripeUnmap (d, m,
+				                                     mbad[i]);
+		numBad += n;
+	}
+	free (mbad); free (lo); free (hi);
+	return numBad;
+}
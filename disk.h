@@ -32,9 +32,101 @@
 //Tamanho padrao do setor de qualquer disco, em bytes
 #define DISK_SECTORDATASIZE 512
 
-//Tipo de dados para a representacao de discos fisicos
+//Tipos de operacao de uma requisicao de E/S de setor
+#define DISK_OPREAD 0
+#define DISK_OPWRITE 1
+
+//Modos de acesso ao arquivo que implementa um disco fisico
+#define DISK_MODEFILE 0		//Leitura e escrita posicionais no arquivo
+#define DISK_MODEMMAP 1		//Arquivo mapeado em memoria
+
+//Formatos do arquivo que implementa um disco fisico
+#define DISK_FORMATFRAMED 0	//Setores enquadrados por preambulo e ECC
+#define DISK_FORMATALIGNED 1	//Setores alinhados, sem enquadramento
+
+//Tipo de dados para a representacao de discos fisicos. Todas as operacoes
+//sobre um mesmo Disk podem ser chamadas concorrentemente por varias threads,
+//exceto diskDisconnect
 typedef struct disk Disk;
 
+//Numero de intervalos do histograma de distancias de deslocamento
+#define DISK_SEEKHISTBUCKETS 16
+
+//Classes de prioridade das requisicoes enfileiradas, da mais para a menos
+//prioritaria
+#define DISK_PRIOSYNC 0		//Primeiro plano, com o chamador esperando
+#define DISK_PRIOASYNC 1	//Primeiro plano, assincrona
+#define DISK_PRIOBACKGROUND 2	//Manutencao em segundo plano
+#define DISK_PRIOCLASSES 3	//Numero de classes
+
+//Tipo de dados para as estatisticas de uso de um disco
+typedef struct diskStats {
+	unsigned long sectorsRead;	//Setores lidos
+	unsigned long sectorsWritten;	//Setores escritos
+	unsigned long numSeeks;		//Acessos que deslocaram a cabeca
+	unsigned long cylindersTraversed; //Total de cilindros percorridos
+	//Histograma de distancias de deslocamento por acesso. O intervalo 0
+	//conta acessos sem deslocamento e o intervalo b > 0, distancias entre
+	//2^(b-1) e 2^b - 1 cilindros. O ultimo intervalo acumula o restante
+	unsigned long seekHist[DISK_SEEKHISTBUCKETS];
+	unsigned long cacheHits;	//Setores atendidos pela cache
+	unsigned long cacheMisses;	//Setores nao encontrados na cache
+	unsigned long checksumErrors;	//Setores lidos com soma incorreta
+	unsigned long trackHits;	//Setores atendidos pelo buffer de trilha
+	//Requisicoes enfileiradas atendidas, soma e maximo de suas latencias
+	//(us no relogio simulado, da submissao a conclusao), por classe
+	unsigned long prioRequests[DISK_PRIOCLASSES];
+	unsigned long prioLatency[DISK_PRIOCLASSES];
+	unsigned long prioMaxLatency[DISK_PRIOCLASSES];
+	unsigned long prioPromoted;	//Promovidas pelo limite de espera
+} DiskStats;
+
+//Tipo de dados para a representacao de uma requisicao de E/S de setor,
+//enfileirada no escalonador de um disco
+typedef struct diskRequest {
+	unsigned long addr;	//Endereco LBA do setor
+	int op;			//Operacao: DISK_OPREAD ou DISK_OPWRITE
+	unsigned char *data;	//Dados do setor (DISK_SECTORDATASIZE bytes)
+	int prio;		//Classe de prioridade: DISK_PRIO*
+	int result;		//0 se atendida sem erros, -1 caso contrario
+	unsigned long submitTime; //Relogio simulado na submissao (preenchido
+				//pelo disco)
+} DiskRequest;
+
+//Tipo de dados para o resultado da reproducao de um rastreamento de E/S
+typedef struct diskReplayResult {
+	unsigned long requests;	//Operacoes reproduzidas
+	unsigned long sectors;	//Setores pedidos pelas operacoes
+	unsigned long failed;	//Setores cuja operacao falhou
+	unsigned long simTime;	//Tempo modelado da reproducao (us)
+	unsigned long traceTime; //Duracao do rastreamento original (us)
+} DiskReplayResult;
+
+//Tipo de dados para o modelo de latencia de um disco. O custo de um acesso e'
+//a soma do deslocamento da cabeca ate o cilindro, da espera rotacional ate o
+//primeiro setor na trilha e da transferencia dos setores, todos em us
+typedef struct diskLatencyModel {
+	//Tempo de deslocamento por dist > 0 cilindros. Se NULL, e' usada a
+	//curva padrao: settleTime + seekShortCoef * raiz(dist) ate
+	//seekShortLimit cilindros, somando seekLongCoef por cilindro alem dele
+	unsigned long (*seekCurve) (const struct diskLatencyModel *m,
+	                            unsigned long dist);
+	unsigned long settleTime;	//Acomodacao da cabeca ao fim do deslocamento
+	unsigned long seekShortCoef;	//Coeficiente da raiz da distancia
+	unsigned long seekShortLimit;	//Maior distancia curta (cilindros)
+	unsigned long seekLongCoef;	//Custo por cilindro alem do limite curto
+	unsigned long rotationTime;	//Periodo de rotacao (0: sem espera)
+	unsigned long transferTime;	//Transferencia por setor (0: rotacao/64)
+} DiskLatencyModel;
+
+//Modelos de latencia predefinidos
+#define DISK_LATENCYLINEAR 0	//Custo linear por cilindro, sem rotacao
+#define DISK_LATENCYROTATIONAL 1 //Curva de deslocamento e posicao rotacional
+
+//Algoritmos de escalonamento da fila de requisicoes de um disco
+#define DISK_SCHEDCLOOK 0	//Varredura circular por cilindro
+#define DISK_SCHEDSPTF 1	//Menor tempo de posicionamento primeiro
+
 //Funcao que conecta um disco fisico ao sistema operacional.
 //Um disco fisico eh implementado por meio de um arquivo regular, 
 //cujo caminho eh dado por rawDiskPath.
@@ -43,13 +135,90 @@ typedef struct disk Disk;
 //Caso contrario, retorna NULL
 Disk* diskConnect(int id, char* diskFilePath);
 
-//Funcao que disconecta um disco fisico do sistema operacional
+//Funcao que conecta um disco fisico ao sistema operacional, como
+//diskConnect, escolhendo o modo de acesso ao arquivo do disco: DISK_MODEFILE
+//(leitura e escrita posicionais no arquivo) ou DISK_MODEMMAP (arquivo
+//mapeado em memoria). O formato do arquivo (DISK_FORMAT*) e' reconhecido
+//automaticamente. Retorna um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectMode(int id, char* diskFilePath, int mode);
+
+//Funcao que conecta um volume virtual que distribui (RAID-0) seus setores
+//entre numMembers discos fisicos, cujos arquivos sao dados por rawDiskPaths.
+//Faixas consecutivas de stripeUnit setores sao alternadas entre os membros,
+//cujas cabecas se movem de forma independente. O volume tem a mesma
+//interface de um disco fisico e a desconexao do volume desconecta tambem os
+//membros. Retorna um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectStriped(int id, char** rawDiskPaths, unsigned int numMembers,
+                         unsigned long stripeUnit);
+
+//Funcao que conecta um disco fisico mantido inteiramente na memoria do
+//processo, com numCylinders cilindros de setores em branco. O disco tem a
+//mesma interface, o mesmo formato de quadros e a mesma contabilizacao de um
+//disco sobre arquivo, sem E/S no sistema hospedeiro. O conteudo e' perdido
+//na desconexao, a menos que salvo por diskSaveMemory. Retorna um ponteiro
+//para Disk ou NULL em caso de falha
+Disk* diskConnectMemory(int id, unsigned long numCylinders);
+
+//Funcao que grava o conteudo do disco em memoria d no arquivo rawDiskPath,
+//como um disco fisico no formato com enquadramento que pode ser conectado
+//por diskConnect ou carregado por diskLoadMemory. Os setores pendentes na
+//cache sao gravados antes; setores nunca gravados ficam como buracos do
+//arquivo. Nao ha custo no relogio simulado. O disco nao deve ser alterado
+//durante a gravacao. Retorna 0 se bem sucedido e -1 caso contrario
+int diskSaveMemory (Disk* d, char* rawDiskPath);
+
+//Funcao que conecta um disco em memoria, como diskConnectMemory, com o
+//conteudo do disco fisico do arquivo rawDiskPath, em qualquer formato e com
+//o mesmo numero de setores, inclusive os de um cilindro final parcial. O
+//arquivo nao e' alterado nem mantido aberto. Retorna um ponteiro para Disk ou
+//NULL em caso de falha
+Disk* diskLoadMemory(int id, char* rawDiskPath);
+
+//Funcao que conecta um volume virtual espelhado (RAID-1) sobre numMembers
+//discos fisicos, cujos arquivos sao dados por rawDiskPaths, com o tamanho do
+//menor deles. Gravacoes vao para todos os membros. Cada leitura e' atendida
+//pelo membro cuja cabeca esta' mais proxima do setor pedido, de modo que
+//fluxos de leitura em regioes distintas tendem a usar membros distintos, e
+//uma leitura que falhe num membro e' repetida nos demais. A desconexao do
+//volume desconecta tambem os membros. Retorna um ponteiro para Disk ou NULL
+//em caso de falha
+Disk* diskConnectMirrored(int id, char** rawDiskPaths,
+                          unsigned int numMembers);
+
+//Funcao que conecta uma sobreposicao com copia na escrita ao disco fisico
+//base do arquivo basePath, que nao e' alterado: setores gravados ficam
+//apenas no delta, um disco fisico esparso no arquivo deltaPath, criado com a
+//geometria da base se ainda nao existir. Leituras de setores nunca gravados
+//na sobreposicao sao atendidas pela base. A base pode ser compartilhada por
+//varias sobreposicoes e ter apenas permissao de leitura. O volume tem a
+//mesma interface de um disco fisico, com um unico relogio simulado. Retorna
+//um ponteiro para Disk ou NULL em caso de falha
+Disk* diskConnectOverlay(int id, char* basePath, char* deltaPath);
+
+//Funcao que descarta todos os setores gravados numa sobreposicao, que volta
+//a ser lida como a base. Copias na cache sao descartadas sem gravacao e o
+//delta e' esvaziado. Retorna 0 se bem sucedido e -1 caso contrario
+int diskOverlayDiscard (Disk* d);
+
+//Funcao que incorpora a base os setores gravados numa sobreposicao, que
+//passam a ser lidos da base, e esvazia o delta. Os setores pendentes na
+//cache sao gravados antes. A base deve ter permissao de escrita e nao estar
+//em uso por outras sobreposicoes. Nao ha custo no relogio simulado do volume.
+//Retorna 0 se bem sucedido e -1 caso contrario
+int diskOverlayCommit (Disk* d);
+
+//Funcao que disconecta um disco fisico do sistema operacional. Setores
+//pendentes na cache sao gravados antes da desconexao
 int diskDisconnect(Disk* d);
 
 //Funcao que retorna o identificador de um disco fisico, conforme atribuido
 //pelo sistema operacional no momento da conexao
 int diskGetId (Disk* d);
 
+//Funcao que retorna o formato do arquivo de um disco fisico: DISK_FORMATFRAMED
+//ou DISK_FORMATALIGNED
+int diskGetFormat (Disk* d);
+
 //Funcao que retorna o numero total de setores de um disco fisico
 unsigned long diskGetNumSectors (Disk* d);
 
@@ -64,6 +233,88 @@ unsigned long diskGetSize (Disk* d);
 //posicionadas em um disco
 unsigned long diskGetCurrentCylinder (Disk* d);
 
+//Funcao que retorna o tempo simulado, em microssegundos, consumido pelos
+//deslocamentos da cabeca e pelas transferencias de setores do disco desde a
+//conexao ou o ultimo diskResetSimTime
+unsigned long diskGetElapsedSimTime (Disk* d);
+
+//Funcao que zera o relogio simulado de um disco
+void diskResetSimTime (Disk* d);
+
+//Funcao que liga (enabled nao nulo) ou desliga o modo de tempo real de um
+//disco. Em tempo real, o posicionamento da cabeca insere um atraso real; caso
+//contrario, o custo e' apenas contabilizado no relogio simulado. Discos sao
+//conectados com o tempo real desligado
+void diskSetRealTime (Disk* d, int enabled);
+
+//Funcao que retorna 1 se o disco estiver em modo de tempo real e 0 caso
+//contrario
+int diskGetRealTime (Disk* d);
+
+//Funcao que preenche *m com o modelo de latencia predefinido preset:
+//DISK_LATENCYLINEAR (10 ms por cilindro e 100 us por setor, sem espera
+//rotacional) ou DISK_LATENCYROTATIONAL (curva de deslocamento com
+//acomodacao, rotacao a 7200 rpm e transferencia de um setor da trilha por
+//1/64 de volta). Retorna 0 se bem sucedido e -1 caso contrario
+int diskGetLatencyPreset (int preset, DiskLatencyModel *m);
+
+//Funcao que troca o modelo de latencia usado no relogio simulado e nos
+//atrasos de tempo real de um disco. Num volume virtual, o modelo e' trocado
+//nos membros. Discos sao conectados com DISK_LATENCYLINEAR
+void diskSetLatencyModel (Disk* d, const DiskLatencyModel *m);
+
+//Funcao que copia para *m o modelo de latencia de um disco
+void diskGetLatencyModel (Disk* d, DiskLatencyModel *m);
+
+//Funcao que liga (enabled nao nulo) ou desliga a verificacao, a cada leitura
+//do meio fisico, da soma CRC32C gravada com cada setor. Uma leitura de setor
+//com soma incorreta falha e e' contada nas estatisticas. Discos sao
+//conectados com a verificacao ligada
+void diskSetVerifyOnRead (Disk* d, int enabled);
+
+//Funcao que retorna 1 se a verificacao na leitura estiver ligada e 0 caso
+//contrario
+int diskGetVerifyOnRead (Disk* d);
+
+//Funcao que verifica as somas CRC32C de count setores a partir do endereco
+//LBA addr, lendo-os diretamente do meio fisico, independentemente da cache e
+//da verificacao na leitura. Ate maxBad enderecos de setores com soma
+//incorreta sao escritos em bad, que pode ser NULL. Pode ser chamada por uma
+//thread em segundo plano, concorrentemente com as demais operacoes sobre o
+//disco. Setores de discos no formato alinhado nao tem somas. Numa
+//sobreposicao, o delta e a base sao verificados; num volume espelhado, todos
+//os membros. Retorna o numero de setores com soma incorreta ou -1 em caso de
+//falha
+long diskScrub (Disk* d, unsigned long addr, unsigned long count,
+                unsigned long *bad, unsigned long maxBad);
+
+//Funcao que copia para *stats as estatisticas de uso de um disco, acumuladas
+//desde a conexao ou o ultimo diskResetStats
+void diskGetStats (Disk* d, DiskStats *stats);
+
+//Funcao que copia para *stats as estatisticas de uso do membro m de um
+//volume virtual (distribuido, espelhado ou sobreposicao, em que o membro 0
+//e' a base e o 1, o delta). Retorna 0 se bem sucedido e -1 se o disco nao
+//tiver o membro m
+int diskGetMemberStats (Disk* d, unsigned int m, DiskStats *stats);
+
+//Funcao que retorna o numero de setores acessados no cilindro cyl (mapa de
+//calor de acessos), ou 0 se o cilindro for invalido. Um cilindro final
+//parcial tem entrada propria, de numero numCylinders
+unsigned long diskGetCylinderHeat (Disk* d, unsigned long cyl);
+
+//Funcao que zera as estatisticas de uso e o mapa de calor de um disco
+void diskResetStats (Disk* d);
+
+//Funcao que grava as estatisticas de uso de um disco no arquivo CSV indicado
+//por csvPath, com linhas no formato tipo,chave,valor: contadores (counter),
+//requisicoes e latencias por classe de prioridade (priorequests,
+//priolatency e priomaxlatency, chave = classe), histograma de distancias de
+//deslocamento (seekhist, chave = menor distancia do intervalo) e mapa de
+//calor por cilindro (cylinder). Retorna 0 se bem sucedido e -1 caso
+//contrario
+int diskDumpStatsCSV (Disk* d, char* csvPath);
+
 //Funcao que escreve em *cyl o numero do cilindro correspondente a um endereco
 //(addr) LBA de setor de um disco. Retorna 0 se o endereco for valido e -1
 //caso contrario
@@ -79,10 +330,202 @@ int diskReadSector (Disk* d, unsigned long addr, unsigned char* data);
 //ocorreu sem erros e -1 caso contrario
 int diskWriteSector (Disk* d, unsigned long int addr, unsigned char* data);
 
+//Funcao para realizar a leitura de count setores contiguos a partir do
+//endereco LBA addr, com um unico posicionamento e uma unica transferencia.
+//Os dados sao transferidos para *data, que deve comportar
+//count*DISK_SECTORDATASIZE bytes. Retorna 0 se a leitura ocorreu sem erros
+//e -1 caso contrario
+int diskReadSectors (Disk* d, unsigned long addr, unsigned long count,
+                     unsigned char *data);
+
+//Funcao para realizar a escrita de count setores contiguos a partir do
+//endereco LBA addr, com um unico posicionamento e uma unica transferencia.
+//Os dados sao transferidos a partir de *data. Retorna 0 se a escrita
+//ocorreu sem erros e -1 caso contrario
+int diskWriteSectors (Disk* d, unsigned long addr, unsigned long count,
+                      unsigned char *data);
+
+//Funcao que descarta count setores contiguos a partir do endereco LBA addr,
+//que passam a ser lidos como setores em branco, como num disco recem-criado.
+//O espaco correspondente no arquivo do disco e' liberado quando o sistema
+//hospedeiro permite. Copias dos setores na cache sao descartadas sem
+//gravacao. Retorna 0 se bem sucedido e -1 caso contrario
+int diskDiscardSectors (Disk* d, unsigned long addr, unsigned long count);
+
+//Funcao que retorna um ponteiro para a area de dados do setor addr dentro
+//do mapeamento em memoria de um disco conectado no modo DISK_MODEMMAP,
+//permitindo acesso sem copia. O custo de posicionamento da cabeca e'
+//contabilizado como numa leitura. Escritas pelo ponteiro sao persistidas no
+//arquivo do disco e vistas pelas leituras seguintes, ja que discos mapeados
+//nao usam a cache de setores, e devem ser declaradas com diskPutSectorData,
+//que atualiza a soma de verificacao. Retorna NULL se o disco nao estiver
+//mapeado ou se o endereco for invalido
+unsigned char* diskGetSectorData (Disk* d, unsigned long addr);
+
+//Funcao que declara a escrita, pelo ponteiro obtido com diskGetSectorData, do
+//setor addr de um disco mapeado em memoria, recalculando a soma de
+//verificacao do setor. Deve ser chamada apos cada alteracao pelo ponteiro e
+//antes de novas leituras do setor. Retorna 0 se bem sucedido e -1 se o disco
+//nao estiver mapeado ou se o endereco for invalido
+int diskPutSectorData (Disk* d, unsigned long addr);
+
+//Funcao que grava no disco todos os setores modificados que ainda estao
+//apenas na cache. Retorna 0 se bem sucedido e -1 caso contrario
+int diskFlush (Disk* d);
+
+//Funcao que redefine a capacidade, em setores, da cache LRU de setores de um
+//disco. Escritas de um unico setor ficam na cache ate serem descartadas ou
+//ate diskFlush; transferencias de varios setores nao alimentam a cache. Os
+//setores modificados sao gravados e a cache e' esvaziada. Capacidade 0
+//desliga a cache. Discos mapeados em memoria nao usam a cache. Retorna 0 se
+//bem sucedido e -1 caso contrario
+int diskSetCacheCapacity (Disk* d, unsigned int capacity);
+
+//Funcao que retorna a capacidade, em setores, da cache de um disco
+unsigned int diskGetCacheCapacity (Disk* d);
+
+//Funcao que liga (enabled nao nulo) ou desliga o buffer de trilha de um
+//disco, com as trilhas lidas mais recentemente. Com o buffer ligado, a
+//leitura de setores de uma trilha ausentes do buffer traz tambem os setores
+//seguintes, ate o fim da trilha, e leituras posteriores desses setores sao
+//atendidas da memoria. Num volume virtual, o buffer e' ligado nos membros.
+//Discos mapeados em memoria ficam sempre sem o buffer. Discos sao conectados
+//com o buffer desligado. Retorna 0 se bem sucedido e -1 caso contrario
+int diskSetTrackBuffer (Disk* d, int enabled);
+
+//Funcao que retorna 1 se o buffer de trilha de um disco estiver ligado e 0
+//caso contrario
+int diskGetTrackBuffer (Disk* d);
+
 //Funcao para a criacao de um disco fisico, a ser representado pelo arquivo
 //regular indicado por rawDiskPath e com numero total de cilindros indicado
 //por numCylinders. Retorna 0 se o disco fisico for criado com sucesso e -1
 //caso contrario. O disco fisico ja eh criado com formatacao de baixo nivel
 int diskCreateRawDisk (char* rawDiskPath, unsigned long numCylinders);
 
+//Funcao para a criacao de um disco fisico esparso, com numCylinders
+//cilindros, no arquivo regular rawDiskPath. Nenhum setor e' gravado: o
+//arquivo e' apenas estendido ate o tamanho do disco e seus buracos sao lidos
+//como setores em branco, ocupando espaco no sistema hospedeiro apenas quando
+//gravados. Retorna 0 se o disco fisico for criado com sucesso e -1 caso
+//contrario
+int diskCreateRawDiskSparse (char* rawDiskPath, unsigned long numCylinders);
+
+//Funcao para a criacao de um disco fisico no formato alinhado
+//(DISK_FORMATALIGNED), com numCylinders cilindros, no arquivo regular
+//rawDiskPath. Os setores, de DISK_SECTORDATASIZE bytes e sem enquadramento,
+//seguem um cabecalho de uma pagina e ficam alinhados a paginas do sistema
+//hospedeiro. Retorna 0 se o disco fisico for criado com sucesso e -1 caso
+//contrario. O disco fisico ja eh criado com setores em branco
+int diskCreateRawDiskAligned (char* rawDiskPath, unsigned long numCylinders);
+
+//Funcao que converte o disco fisico do arquivo srcPath, em qualquer
+//formato, para o formato format (DISK_FORMATFRAMED ou DISK_FORMATALIGNED),
+//gravando o resultado no arquivo dstPath, distinto da origem. Setores em
+//branco nao sao copiados; no formato com enquadramento, o destino e' criado
+//esparso. O destino tem o mesmo numero de setores da origem, inclusive os de
+//um cilindro final parcial. Retorna 0 se bem sucedido e -1 caso contrario
+int diskConvertRawDisk (char* srcPath, char* dstPath, int format);
+
+//Funcao para a criacao de um disco fisico como diskCreateRawDisk, dividindo
+//os cilindros em faixas disjuntas gravadas em paralelo por numThreads
+//threads. O arquivo resultante e' identico ao de diskCreateRawDisk. Retorna 0
+//se o disco fisico for criado com sucesso e -1 caso contrario
+int diskCreateRawDiskParallel (char* rawDiskPath, unsigned long numCylinders,
+                               unsigned int numThreads);
+
+//Funcao que enfileira um lote de n requisicoes de setor no disco d, sem
+//atende-las. As requisicoes devem permanecer validas ate o atendimento por
+//diskQueueDispatch. Retorna 0 se bem sucedido ou -1 caso contrario
+int diskQueueSubmit (Disk *d, DiskRequest *reqs, unsigned int n);
+
+//Funcao que escolhe o algoritmo de escalonamento da fila do disco d:
+//DISK_SCHEDCLOOK ou DISK_SCHEDSPTF, que atende primeiro a requisicao de
+//menor tempo de posicionamento (deslocamento e espera rotacional) segundo o
+//modelo de latencia do disco. Discos sao conectados com DISK_SCHEDCLOOK.
+//Retorna 0 se bem sucedido e -1 caso contrario
+int diskSetScheduler (Disk *d, int sched);
+
+//Funcao que retorna o algoritmo de escalonamento da fila do disco d
+int diskGetScheduler (Disk *d);
+
+//Funcao que atende todas as requisicoes pendentes na fila do disco d, por
+//classe de prioridade e, dentro de cada classe, na ordem do algoritmo de
+//escalonamento do disco (C-LOOK a partir do cilindro atual ou SPTF a partir
+//da posicao atual da cabeca). Requisicoes que esperaram mais que o limite de
+//espera do disco sao promovidas a DISK_PRIOSYNC. Requisicoes de mesma
+//operacao sobre setores adjacentes sao agrupadas numa unica transferencia.
+//O resultado de cada requisicao e' escrito em seu campo result. Retorna o
+//numero de requisicoes mal sucedidas ou -1 em caso de falha
+int diskQueueDispatch (Disk *d);
+
+//Funcao que define o limite de espera, em us do relogio simulado, das
+//requisicoes enfileiradas no disco d: uma requisicao de classe DISK_PRIOASYNC
+//ou DISK_PRIOBACKGROUND que espere mais que limit e' atendida como
+//DISK_PRIOSYNC. Limite 0 desliga a promocao. Discos sao conectados com
+//limite de 1 s
+void diskSetPriorityAgeLimit (Disk *d, unsigned long limit);
+
+//Funcao que retorna o limite de espera, em us, das requisicoes enfileiradas
+//no disco d
+unsigned long diskGetPriorityAgeLimit (Disk *d);
+
+//Funcao que retorna quantos cilindros de deslocamento o escalonador
+//economizou, desde a conexao do disco, em relacao ao atendimento das mesmas
+//requisicoes em ordem de chegada. Pode ser negativo
+long diskQueueGetSeekSaved (Disk *d);
+
+//Funcao que liga a E/S assincrona do disco d, com aneis de submissao e de
+//conclusao de depth requisicoes e uma thread trabalhadora que atende as
+//submissoes em lotes, como diskQueueDispatch. A cada lote, as requisicoes de
+//classe DISK_PRIOBACKGROUND atendidas formam uma unica transferencia de ate
+//uma trilha, de modo que novas requisicoes de primeiro plano esperem no
+//maximo essa transferencia.
+//Retorna 0 se bem sucedido e -1 caso contrario, inclusive se ja estiver
+//ligada
+int diskAsyncStart (Disk *d, unsigned int depth);
+
+//Funcao que submete, sem bloquear, ate n requisicoes de setor do vetor reqs
+//a E/S assincrona do disco d. As requisicoes devem permanecer validas ate
+//serem colhidas por diskAsyncReap. Retorna quantas requisicoes, do inicio de
+//reqs, foram submetidas (menos que n se o anel estiver cheio) ou -1 se a E/S
+//assincrona nao estiver ligada
+int diskAsyncSubmit (Disk *d, DiskRequest *reqs, unsigned int n);
+
+//Funcao que colhe ate max requisicoes concluidas da E/S assincrona do disco
+//d, escrevendo seus enderecos em done, na ordem de conclusao. O resultado de
+//cada uma esta' em seu campo result. Se wait nao for nulo e houver
+//requisicoes em voo, bloqueia ate que ao menos uma seja concluida. Retorna o
+//numero de requisicoes colhidas ou -1 se a E/S assincrona nao estiver ligada
+int diskAsyncReap (Disk *d, DiskRequest **done, unsigned int max, int wait);
+
+//Funcao que desliga a E/S assincrona do disco d. As requisicoes ja
+//submetidas sao atendidas antes e as conclusoes nao colhidas sao descartadas.
+//Chamada tambem por diskDisconnect. Retorna 0 se bem sucedido e -1 caso
+//contrario
+int diskAsyncStop (Disk *d);
+
+//Funcao que liga o rastreamento de E/S de um disco, registrando no arquivo
+//binario tracePath cada leitura e escrita de setores pedida ao disco: instante
+//em microssegundos desde o inicio do rastreamento, endereco LBA, cilindro,
+//numero de setores e operacao. Um rastreamento anterior e' encerrado. Retorna
+//0 se bem sucedido e -1 caso contrario
+int diskTraceStart (Disk *d, char *tracePath);
+
+//Funcao que encerra o rastreamento de E/S de um disco, se ligado, fechando o
+//arquivo de rastreamento. Retorna 0 se bem sucedido e -1 caso contrario
+int diskTraceStop (Disk *d);
+
+//Funcao que reproduz sobre o disco d as operacoes gravadas no arquivo de
+//rastreamento tracePath, na configuracao atual do disco (cache, relogio). Com
+//batch 0, as operacoes sao atendidas em ordem de chegada; caso contrario, sao
+//agrupadas em lotes de ate batch setores (ou uma unica operacao maior),
+//atendidos pelo escalonador configurado no disco (C-LOOK ou SPTF). As
+//escritas gravam setores zerados, portanto a reproducao deve ser feita sobre
+//uma copia do disco. Os setores modificados na cache sao gravados ao final. O
+//resultado e' escrito em *result. Retorna 0 se bem sucedido e -1 se o
+//rastreamento nao puder ser lido
+int diskTraceReplay (Disk *d, char *tracePath, unsigned int batch,
+                     DiskReplayResult *result);
+
 #endif
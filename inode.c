@@ -11,6 +11,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "inode.h"
 #include "util.h"
 
@@ -27,14 +28,253 @@
 #define INODE_ITEM_PERMISSION (INODE_SIZE - 4)	//Item 12: Permissao
 #define INODE_ITEM_REFCOUNT (INODE_SIZE - 3)	//Item 13: Contador referencia
 
+#define INODE_BITMAPSECTOR 1	//Setor do mapa de i-nodes livres
+#define INODE_BITMAPHEADER 8	//Bytes de cabecalho do mapa: "IMAP" e no. de
+				//i-nodes, seguidos de um bit por i-node
+#define INODE_BITMAPMAX ((DISK_SECTORDATASIZE - INODE_BITMAPHEADER) * 8)
+#define INODE_BITMAPWORDS ((INODE_BITMAPMAX + 63) / 64)
+
+#define INODE_CACHEBUCKETS 64	//Numero de baldes da cache de i-nodes
+#define INODE_CACHEMAX 256	//Numero de i-nodes a partir do qual a cache
+				//passa a despejar i-nodes sem referencias
+#define INODE_BATCHSECTORS 16	//Maximo de setores contiguos gravados de uma
+				//so vez pela gravacao em lote de i-nodes
+
 //Tipo para representacao de i-nodes
 struct inode {
 	unsigned int inodeItem[NUMITEMS_PERINODE]; //Blocos e dados do i-node
 	unsigned int number; 	//Numero do i-node
 	unsigned int next;	//Numero do proximo i-node em caso de extensao
 	Disk *d; 		//Disco ao qual pertence o i-node
+	unsigned int refs;	//Referencias ao i-node obtidas com inodeGet
+	int dirty;		//Indica alteracoes ainda nao gravadas em disco
+	int cached;		//Indica se o i-node pertence 'a cache
+	struct inode *hashNext;	//Proximo i-node no mesmo balde da cache
+	unsigned int *blockMap;	//Enderecos de todos os blocos da cadeia, na
+				//ordem do arquivo, para i-nodes em cache
+	unsigned int mapLen;	//Numero de enderecos em blockMap
+	unsigned int mapCap;	//Capacidade de blockMap
+	struct inode *tail;	//Copia da ultima extensao da cadeia ou NULL se
+				//nao houver extensoes
+	unsigned int tailFill;	//Enderecos de bloco em uso na ultima extensao,
+				//ou no proprio i-node se nao houver extensoes
+	int tailValid;		//Indica se tail e tailFill estao atualizados
 };
 
+//Tipo para a copia em memoria do mapa de i-nodes livres de um disco, gravada
+//no disco a cada alteracao. O bit number-1 indica se o i-node number esta' em
+//uso; bits alem de numInodes permanecem ligados
+typedef struct inodeBitmap {
+	Disk *d;			//Disco ao qual pertence o mapa
+	unsigned int numInodes;		//Numero de i-nodes do disco
+	unsigned int firstFree;		//Nenhuma palavra antes desta tem bit livre
+	unsigned long long words[INODE_BITMAPWORDS];
+	struct inodeBitmap *next;	//Mapa do proximo disco
+} InodeBitmap;
+
+//Cache de i-nodes em memoria, indexada pelo numero do i-node
+static Inode *inodeCache[INODE_CACHEBUCKETS];
+static unsigned int inodeCacheCount = 0;
+
+//Mapas de i-nodes livres carregados, um por disco
+static InodeBitmap *inodeBitmaps = NULL;
+
+//Funcao interna que retorna o mapa de i-nodes livres carregado do disco d ou
+//NULL se nao houver
+InodeBitmap* __inodeBitmapLookup (Disk *d) {
+	InodeBitmap *m = inodeBitmaps;
+	while (m && m->d != d) m = m->next;
+	return m;
+}
+
+//Funcao interna que grava em disco o mapa de i-nodes livres m. Retorna 0 se
+//bem sucedido ou -1, caso contrario
+int __inodeBitmapSave (InodeBitmap *m) {
+	unsigned char sector[DISK_SECTORDATASIZE];
+	memset (sector, 0, sizeof(sector));
+	memcpy (sector, "IMAP", 4);
+	ul2char (m->numInodes, &sector[4]);
+	for (unsigned int b = 0; b < m->numInodes; b++)
+		if (m->words[b / 64] & (1ULL << (b % 64)))
+			sector[INODE_BITMAPHEADER + b / 8] |= 1 << (b % 8);
+	return diskWriteSector (m->d, INODE_BITMAPSECTOR, sector);
+}
+
+//Funcao interna que cria, ou reinicia se ja existir, o mapa em memoria do
+//disco d para numInodes i-nodes, todos livres. Retorna NULL em caso de falha
+InodeBitmap* __inodeBitmapInit (Disk *d, unsigned int numInodes) {
+	InodeBitmap *m = __inodeBitmapLookup (d);
+	if (!m) {
+		m = malloc (sizeof(InodeBitmap));
+		if (!m) return NULL;
+		m->d = d;
+		m->next = inodeBitmaps;
+		inodeBitmaps = m;
+	}
+	m->numInodes = numInodes;
+	m->firstFree = 0;
+	for (unsigned int w = 0; w < INODE_BITMAPWORDS; w++)
+		m->words[w] = ~0ULL;
+	for (unsigned int b = 0; b < numInodes; b++)
+		m->words[b / 64] &= ~(1ULL << (b % 64));
+	return m;
+}
+
+//Funcao interna que descarta o mapa de i-nodes livres em memoria do disco d
+void __inodeBitmapDrop (Disk *d) {
+	InodeBitmap **p = &inodeBitmaps;
+	while (*p && (*p)->d != d) p = &(*p)->next;
+	if (*p) {
+		InodeBitmap *m = *p;
+		*p = m->next;
+		free (m);
+	}
+}
+
+//Funcao interna que procura na cache o i-node de numero number do disco d.
+//Retorna NULL se o i-node nao estiver na cache
+Inode* __inodeCacheLookup (unsigned int number, Disk *d) {
+	Inode *i = inodeCache[number % INODE_CACHEBUCKETS];
+	while (i && (i->number != number || i->d != d)) i = i->hashNext;
+	return i;
+}
+
+//Funcao interna que libera um i-node, seu mapa de blocos e a copia de sua
+//ultima extensao
+void __inodeFree (Inode *i) {
+	free (i->blockMap);
+	free (i->tail);
+	free (i);
+}
+
+//Funcao interna que descarta a copia da ultima extensao de um i-node, que
+//sera' localizada novamente na proxima inclusao de bloco
+void __inodeTailInvalidate (Inode *i) {
+	free (i->tail);
+	i->tail = NULL;
+	i->tailFill = 0;
+	i->tailValid = 0;
+}
+
+//Funcao interna que descarta o mapa de blocos de um i-node, que sera'
+//reconstruido no proximo acesso
+void __inodeMapInvalidate (Inode *i) {
+	free (i->blockMap);
+	i->blockMap = NULL;
+	i->mapLen = i->mapCap = 0;
+}
+
+//Funcao interna que acrescenta um endereco ao fim do mapa de blocos de um
+//i-node. Retorna 0 se bem sucedido ou -1 se nao houver memoria suficiente
+int __inodeMapAppend (Inode *i, unsigned int blockAddr) {
+	if (i->mapLen == i->mapCap) {
+		unsigned int cap = i->mapCap ? 2 * i->mapCap : 
+			NUMBLOCKS_PERINODE + NUMITEMS_PERINODE;
+		unsigned int *map = realloc (i->blockMap, cap * sizeof(unsigned int));
+		if (!map) return -1;
+		i->blockMap = map;
+		i->mapCap = cap;
+	}
+	i->blockMap[i->mapLen++] = blockAddr;
+	return 0;
+}
+
+//Funcao interna que mantem o mapa de blocos de um i-node, se ja construido,
+//em sincronia com a inclusao de um novo bloco ao fim de sua cadeia
+void __inodeMapAdd (Inode *i, unsigned int blockAddr) {
+	if (i->blockMap && __inodeMapAppend (i, blockAddr) < 0)
+		__inodeMapInvalidate (i);
+}
+
+//Funcao interna que constroi o mapa de blocos de um i-node em cache,
+//percorrendo uma unica vez sua cadeia de extensoes. Retorna 0 se bem sucedido
+//ou -1, caso contrario
+int __inodeMapBuild (Inode *i) {
+	int ret = 0;
+	for (int a = 0; a < NUMBLOCKS_PERINODE && i->inodeItem[a] != 0; a++)
+		if (__inodeMapAppend (i, i->inodeItem[a]) < 0) ret = -1;
+	unsigned int niNumber = i->next;
+	while (niNumber != 0 && ret == 0) {
+		Inode *ni = inodeLoad (niNumber, i->d);
+		if (!ni) {
+			ret = -1;
+			break;
+		}
+		for (int a = 0; a < NUMITEMS_PERINODE && ni->inodeItem[a] != 0; a++)
+			if (__inodeMapAppend (i, ni->inodeItem[a]) < 0) ret = -1;
+		niNumber = ni->next;
+		free (ni);
+	}
+	if (ret < 0) __inodeMapInvalidate (i);
+	return ret;
+}
+
+//Funcao interna que faz a copia em cache do i-node number, se houver, refletir
+//um i-node recem-criado, vazio e ja gravado em disco
+void __inodeCacheReset (unsigned int number, Disk *d) {
+	Inode *c = __inodeCacheLookup (number, d);
+	if (c) {
+		for (int a = 0; a < NUMITEMS_PERINODE; a++)
+			c->inodeItem[a] = 0;
+		c->next = 0;
+		c->dirty = 0;
+		__inodeMapInvalidate (c);
+		__inodeTailInvalidate (c);
+	}
+}
+
+//Funcao interna que retorna o setor no qual o i-node number e' gravado
+unsigned long int __inodeSectorAddr (unsigned int number) {
+	return INODE_BEGINSECTOR + (number - 1) * INODE_SIZE 
+		* sizeof(unsigned int) / DISK_SECTORDATASIZE;
+}
+
+//Funcao interna que copia um i-node para sua posicao no setor sector
+void __inodePack (Inode *i, unsigned char *sector) {
+	unsigned long int sizeUInt = sizeof(unsigned int);
+	//Posicao de inicio do i-node dentro do setor
+	unsigned long int offset = ((i->number - 1) % 
+		   (DISK_SECTORDATASIZE / (INODE_SIZE * sizeUInt)))
+		   * INODE_SIZE * sizeUInt;
+
+	//Alterando enderecos de blocos e atributos do i-node no setor
+	for (int a=0; a < NUMITEMS_PERINODE; a++)
+		ul2char (i->inodeItem[a], 
+		         &sector[offset+a*sizeUInt]);
+	ul2char (i->number, 
+	         &sector[offset+(INODE_SIZE-2)*sizeUInt]);
+	ul2char (i->next, 
+		 &sector[offset+(INODE_SIZE-1)*sizeUInt]);
+}
+
+//Funcao interna de comparacao para ordenar i-nodes por disco e numero
+int __inodeCompareNumber (const void *a, const void *b) {
+	const Inode *x = *(Inode * const *) a, *y = *(Inode * const *) b;
+	if (x->d != y->d) return (x->d < y->d) ? -1 : 1;
+	if (x->number != y->number) return (x->number < y->number) ? -1 : 1;
+	return 0;
+}
+
+//Funcao interna que retira da cache e libera um i-node sem referencias,
+//gravando-o antes em disco se estiver sujo. Retorna 0 se algum i-node foi
+//despejado ou -1, caso contrario
+int __inodeCacheEvict ( void ) {
+	for (int b = 0; b < INODE_CACHEBUCKETS; b++) {
+		Inode **p = &inodeCache[b];
+		while (*p) {
+			Inode *i = *p;
+			if (i->refs == 0 && (!i->dirty || inodeSave (i) == 0)) {
+				*p = i->hashNext;
+				inodeCacheCount--;
+				__inodeFree (i);
+				return 0;
+			}
+			p = &i->hashNext;
+		}
+	}
+	return -1;
+}
+
 //Funcao interna que retorna a ultima extensao de um i-node. Retorna NULL
 //se nao houver extensoes do i-node fornecido.
 Inode* __inodeGetLastExtension (Inode *i) {
@@ -55,6 +295,54 @@ Inode* __inodeGetLastExtension (Inode *i) {
 	return i;
 }
 
+//Funcao interna que localiza, se ainda nao conhecidos, a ultima extensao de um
+//i-node e quantos enderecos de bloco ela ja' possui. Retorna 0 se bem
+//sucedido ou -1, caso contrario
+int __inodeTailResolve (Inode *i) {
+	if (i->tailValid) return 0;
+	Inode *last = __inodeGetLastExtension (i);
+	if (!last && i->next != 0) return -1;
+	Inode *l = last ? last : i;
+	unsigned int numblocks = last ? NUMITEMS_PERINODE : NUMBLOCKS_PERINODE;
+	unsigned int fill = 0;
+	while (fill < numblocks && l->inodeItem[fill] != 0) fill++;
+	i->tail = last;
+	i->tailFill = fill;
+	i->tailValid = 1;
+	return 0;
+}
+
+//Funcao interna que encadeia uma nova extensao, contendo apenas blockAddr, ao
+//fim da cadeia do i-node i, cujo ultimo elemento (last) esta' cheio. O ultimo
+//elemento e a nova extensao sao gravados juntos com inodeSaveBatch. Retorna 0
+//se bem sucedido ou -1, caso contrario
+int __inodeTailExtend (Inode *i, Inode *last, unsigned int blockAddr) {
+	Disk *d = i->d;
+	unsigned int niNumber = inodeFindFreeInode (last->number, d);
+	if (!niNumber) return -1;
+	Inode *ni = malloc (sizeof(Inode));
+	if (!ni) {
+		inodeFreeInode (niNumber, d);
+		return -1;
+	}
+	memset (ni, 0, sizeof(Inode));
+	ni->number = niNumber;
+	ni->d = d;
+	ni->inodeItem[0] = blockAddr;
+	last->next = niNumber;
+	Inode *list[2] = {last, ni};
+	if (inodeSaveBatch (list, 2) < 0) {
+		last->next = 0;
+		free (ni);
+		inodeFreeInode (niNumber, d);
+		return -1;
+	}
+	free (i->tail);
+	i->tail = ni;
+	i->tailFill = 1;
+	return 0;
+}
+
 //Funcao que retorna o numero de i-nodes por setor
 unsigned int inodeNumInodesPerSector ( void ) {
 	return DISK_SECTORDATASIZE / (INODE_SIZE * sizeof (unsigned int));
@@ -78,10 +366,20 @@ unsigned int inodeNumBlockAddresses ( void ) {
 Inode* inodeCreate (unsigned int number, Disk *d) {
 	if (number < 1) return NULL;
 	Inode *i = malloc (sizeof(Inode));
+	if (!i) return NULL;
 	i->d = d;
 	i->number = number;
 	i->next = 0;
-	if ( inodeClear (i) == 0 ) return i;
+	i->refs = i->dirty = i->cached = 0;
+	i->hashNext = NULL;
+	i->blockMap = NULL;
+	i->mapLen = i->mapCap = 0;
+	i->tail = NULL;
+	i->tailFill = i->tailValid = 0;
+	if ( inodeClear (i) == 0 ) {
+		__inodeCacheReset (number, d);
+		return i;
+	}
 	else free (i);
 	return NULL;
 }
@@ -102,6 +400,8 @@ int inodeClear (Inode *i) {
 		i->next = 0;
 		for (int a = 0; a < NUMITEMS_PERINODE; a++)
 			i->inodeItem[a] = 0;
+		__inodeMapInvalidate (i);
+		__inodeTailInvalidate (i);
 		return inodeSave(i);
 	}
 	return -1;
@@ -114,37 +414,112 @@ int inodeClear (Inode *i) {
 //cada setor pode receber 8 i-nodes 
 int inodeSave (Inode *i) {
 	if (i) {
-		unsigned long int sizeUInt = sizeof(unsigned int);
 		//Endereco do setor no qual o i-node sera' salvo
-		unsigned long int inodeSectorAddr = 
-			INODE_BEGINSECTOR + (i->number - 1) * INODE_SIZE 
-			* sizeUInt / DISK_SECTORDATASIZE;
+		unsigned long int inodeSectorAddr = __inodeSectorAddr (i->number);
 		unsigned char sector[DISK_SECTORDATASIZE];
 
 		int ret = diskReadSector (i->d, inodeSectorAddr, sector);
 		if (ret < 0) return ret;
 
-		//Posicao de inicio do i-node dentro do setor
-		unsigned long int offset = ((i->number - 1) % 
-			   (DISK_SECTORDATASIZE / (INODE_SIZE * sizeUInt)))
-                           * INODE_SIZE * sizeUInt;
-
-		//Alterando enderecos de blocos e atributos do i-node no setor
-		for (int a=0; a < NUMITEMS_PERINODE; a++)
-			ul2char (i->inodeItem[a], 
-			         &sector[offset+a*sizeUInt]);
-		ul2char (i->number, 
-		         &sector[offset+(INODE_SIZE-2)*sizeUInt]);
-		ul2char (i->next, 
-			 &sector[offset+(INODE_SIZE-1)*sizeUInt]);
+		__inodePack (i, sector);
 
 		//Salvando todo o setor onde se encontra o i-node...
 		ret = diskWriteSector (i->d, inodeSectorAddr, sector);
+		if (ret == 0) i->dirty = 0;
 		return ret;
 	}
 	return -1;
 }
 
+//Funcao que persiste em disco os n i-nodes de list, agrupando-os por setor.
+//Cada setor e' gravado uma unica vez com todas as suas alteracoes, e so e' lido
+//antes se nem todos os seus i-nodes estiverem em list. Setores contiguos sao
+//gravados juntos. Retorna 0 se bem sucedido ou -1, caso contrario
+int inodeSaveBatch (Inode **list, unsigned int n) {
+	if (!list) return -1;
+	if (n == 0) return 0;
+	Inode **sorted = malloc (n * sizeof(Inode*));
+	if (!sorted) return -1;
+	memcpy (sorted, list, n * sizeof(Inode*));
+	qsort (sorted, n, sizeof(Inode*), __inodeCompareNumber);
+
+	unsigned int perSector = inodeNumInodesPerSector ();
+	unsigned long long fullSector = (perSector >= 64) ? ~0ULL
+		: (1ULL << perSector) - 1;
+	unsigned char run[INODE_BATCHSECTORS * DISK_SECTORDATASIZE];
+	unsigned long int runStart = 0;
+	unsigned int runLen = 0;
+	Disk *runDisk = NULL;
+	int ret = 0;
+	unsigned int a = 0;
+	while (a < n) {
+		Disk *d = sorted[a]->d;
+		unsigned long int addr = __inodeSectorAddr (sorted[a]->number);
+		unsigned long long covered = 0;
+		unsigned int b = a;
+		while (b < n && sorted[b]->d == d &&
+		       __inodeSectorAddr (sorted[b]->number) == addr) {
+			covered |= 1ULL << ((sorted[b]->number - 1) % perSector);
+			b++;
+		}
+		//Setor nao contiguo aos acumulados: grava os acumulados
+		if (runLen && (runDisk != d || runStart + runLen != addr ||
+		               runLen == INODE_BATCHSECTORS)) {
+			ret = diskWriteSectors (runDisk, runStart, runLen, run);
+			runLen = 0;
+			if (ret < 0) break;
+		}
+		unsigned char *sector = run + runLen * DISK_SECTORDATASIZE;
+		//Setor parcialmente coberto: preserva os demais i-nodes
+		if (covered != fullSector) {
+			ret = diskReadSector (d, addr, sector);
+			if (ret < 0) break;
+		}
+		for (; a < b; a++)
+			__inodePack (sorted[a], sector);
+		if (runLen == 0) {
+			runStart = addr;
+			runDisk = d;
+		}
+		runLen++;
+	}
+	if (ret == 0 && runLen)
+		ret = diskWriteSectors (runDisk, runStart, runLen, run);
+	if (ret == 0)
+		for (a = 0; a < n; a++) list[a]->dirty = 0;
+	free (sorted);
+	return (ret < 0) ? -1 : 0;
+}
+
+//Funcao que cria count i-nodes vazios, de numeros first a first+count-1,
+//gravando-os em lote com inodeSaveBatch. Copias em cache desses i-nodes
+//passam a refletir o conteudo vazio. Retorna 0 se bem sucedido ou -1, caso
+//contrario
+int inodeCreateRange (unsigned int first, unsigned int count, Disk *d) {
+	if (first < 1 || !d) return -1;
+	if (count == 0) return 0;
+	Inode *inodes = malloc (count * sizeof(Inode));
+	Inode **list = malloc (count * sizeof(Inode*));
+	if (!inodes || !list) {
+		free (inodes);
+		free (list);
+		return -1;
+	}
+	for (unsigned int a = 0; a < count; a++) {
+		memset (&inodes[a], 0, sizeof(Inode));
+		inodes[a].number = first + a;
+		inodes[a].d = d;
+		list[a] = &inodes[a];
+	}
+	int ret = inodeSaveBatch (list, count);
+	if (ret == 0)
+		for (unsigned int a = 0; a < count; a++)
+			__inodeCacheReset (first + a, d);
+	free (list);
+	free (inodes);
+	return ret;
+}
+
 //Funcao que recupera um i-node a partir do disco. Retorna ponteiro para o
 //i-node lido ou NULL em caso de falha.
 Inode* inodeLoad (unsigned int number, Disk *d) {
@@ -167,6 +542,12 @@ Inode* inodeLoad (unsigned int number, Disk *d) {
 	i = malloc (sizeof(Inode));
 	if (i) {
 		i->d = d;
+		i->refs = i->dirty = i->cached = 0;
+		i->hashNext = NULL;
+		i->blockMap = NULL;
+		i->mapLen = i->mapCap = 0;
+		i->tail = NULL;
+		i->tailFill = i->tailValid = 0;
 		//Recuperando enderecos de blocos e atributos do i-node no setor
 		for (int a=0; a < NUMITEMS_PERINODE; a++)
 			char2ul (&sector[offset+a*sizeUInt],
@@ -211,50 +592,30 @@ void inodeSetRefCount (Inode *i, unsigned int refCount) {
 
 //Funcao que adiciona um endereco ao fim do array de blocos de um i-node
 //Retorna -1 caso a inclusao do endereco nao seja bem sucedida
-//E' a unica funcao que salva automaticamente o i-node em disco
+//E' a unica funcao que salva automaticamente o i-node em disco. Apenas o
+//elemento alterado da cadeia e' gravado: a ultima extensao e quantos blocos
+//ela possui sao mantidos no i-node, sem percorrer a cadeia a cada inclusao
 int inodeAddBlock (Inode *i, unsigned int blockAddr) {
 	if (i) {
-		Disk *d = i->d;
-		Inode* lastInodeExt = NULL;
-		unsigned int niNumber;
-		int ret, numblocks = NUMBLOCKS_PERINODE;
-		lastInodeExt = __inodeGetLastExtension (i);
-		if (lastInodeExt) {
-			numblocks = NUMITEMS_PERINODE;
-			if ( inodeSave (i) < 0 ) return -1;
-		}
-		else if (i->next != 0) return -1;
-		else lastInodeExt = i;
-
-		for (int a = 0; a < numblocks; a++)
-			//Encontrar bloco sem endereco
-			if (lastInodeExt->inodeItem[a] == 0) {
-				lastInodeExt->inodeItem[a] = blockAddr;
-				ret = inodeSave(lastInodeExt);
-				if (numblocks != NUMBLOCKS_PERINODE) 
-					free (lastInodeExt);
-				return ret;
+		int ret = -1;
+		if (__inodeTailResolve (i) == 0) {
+			Inode *last = i->tail ? i->tail : i;
+			unsigned int numblocks = i->tail ? NUMITEMS_PERINODE
+				: NUMBLOCKS_PERINODE;
+			if (i->tailFill < numblocks) {
+				//Preencher o proximo bloco sem endereco
+				last->inodeItem[i->tailFill] = blockAddr;
+				ret = inodeSave (last);
+				if (ret == 0) i->tailFill++;
+				else last->inodeItem[i->tailFill] = 0;
 			}
-		//i-node esta' sem bloco a preencher. Obter nova extensao
-		niNumber = inodeFindFreeInode (lastInodeExt->number, d);
-		if (niNumber) {
-			lastInodeExt->next = niNumber;
-			ret = inodeSave (lastInodeExt);
-			if (numblocks != NUMBLOCKS_PERINODE) 
-				free (lastInodeExt);
-			if (ret < 0) return ret;
+			//i-node esta' sem bloco a preencher. Obter nova extensao
+			else ret = __inodeTailExtend (i, last, blockAddr);
 		}
-		else {
-			if (numblocks != NUMBLOCKS_PERINODE)
-				free (lastInodeExt);
-			return -1;
-		}
-		lastInodeExt = inodeLoad (niNumber, d);
-		if (!lastInodeExt) return -1;
-		lastInodeExt->inodeItem[0] = blockAddr;
-		ret = inodeSave (lastInodeExt);
-		free (lastInodeExt);
-		return ret;
+		if (ret == 0) __inodeMapAdd (i, blockAddr);
+		//Apenas i-nodes em cache mantem a copia da ultima extensao
+		if (!i->cached) __inodeTailInvalidate (i);
+		return (ret < 0) ? -1 : 0;
 	}
 	return -1;
 }
@@ -306,26 +667,37 @@ unsigned int inodeGetRefCount (Inode *i) {
 
 //Funcao que retorna o endereco correspondente a um bloco (blockNum) no array
 //de blocos de um i-node. O i-node precisa ser o primeiro de sua cadeia.
-//Retorna 0 se o bloco nao possuir endereco em blockNum
+//Retorna 0 se o bloco nao possuir endereco em blockNum. Para i-nodes obtidos
+//com inodeGet, blocos alem do i-node sao resolvidos por um mapa de blocos
+//construido no primeiro acesso, sem novas leituras da cadeia de extensoes
 unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum) {
-	unsigned int numblocks = NUMBLOCKS_PERINODE;
 	if (i) {
 		if (blockNum < NUMBLOCKS_PERINODE)
 			return i->inodeItem[blockNum];
+		else if (i->cached) {
+			if (!i->blockMap && __inodeMapBuild (i) < 0) return 0;
+			return (blockNum < i->mapLen) ? i->blockMap[blockNum] : 0;
+		}
 		else {
 			unsigned int extNum = 1 + 
 			                      (blockNum - NUMBLOCKS_PERINODE) 
 			                      / NUMITEMS_PERINODE;
 			unsigned int offset = (blockNum - NUMBLOCKS_PERINODE)
 			                      % NUMITEMS_PERINODE;
+			unsigned int addr = 0;
+			if (i->next == 0) return 0;
 			Inode *ni = inodeLoad (i->next, i->d);
-			for (int a = 1; a < extNum; a++) {
+			for (int a = 1; ni && a < extNum; a++) {
 				Disk *d = ni->d;
 				unsigned int niNumber = ni->next;
 				free (ni);
-				ni = inodeLoad (niNumber, d);
+				ni = niNumber ? inodeLoad (niNumber, d) : NULL;
 			}
-			return ni->inodeItem[offset];
+			if (ni) {
+				addr = ni->inodeItem[offset];
+				free (ni);
+			}
+			return addr;
 		}
 	}
 	return 0;
@@ -333,11 +705,47 @@ unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum) {
 
 //Funcao que encontra um i-node livre em um disco, a partir do i-node de numero
 //startFrom. Retorna o numero do inode livre encontrado ou 0 se nao encontrado.
+//Se o mapa de i-nodes livres do disco estiver carregado, a busca e' feita nele,
+//uma palavra de 64 i-nodes por vez, e o i-node encontrado e' marcado como em
+//uso, com o mapa gravado em disco. Caso contrario, os i-nodes sao lidos um a
+//um e e' considerado livre o que nao possuir bloco
 unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d) {
 	Inode *i = NULL;
 	unsigned int number = 0;
 	if (startFrom < 1) return 0;
+	InodeBitmap *m = __inodeBitmapLookup (d);
+	if (m) {
+		unsigned int start = startFrom - 1;
+		unsigned int w = start / 64;
+		if (w < m->firstFree) {
+			w = m->firstFree;
+			start = w * 64;
+		}
+		for (; w < INODE_BITMAPWORDS; w++) {
+			unsigned long long freeBits = ~m->words[w];
+			//Ignora os i-nodes anteriores a startFrom na primeira palavra
+			if (w == start / 64) freeBits &= ~0ULL << (start % 64);
+			if (freeBits == 0) continue;
+			unsigned int b = w * 64 + __builtin_ctzll (freeBits);
+			m->words[w] |= 1ULL << (b % 64);
+			if (__inodeBitmapSave (m) < 0) {
+				m->words[w] &= ~(1ULL << (b % 64));
+				return 0;
+			}
+			while (m->firstFree < INODE_BITMAPWORDS &&
+			       m->words[m->firstFree] == ~0ULL)
+				m->firstFree++;
+			return b + 1;
+		}
+		return 0;
+	}
 	for (unsigned int a = startFrom; number == 0; a++) {
+		//A copia em cache pode conter alteracoes ainda nao gravadas
+		i = __inodeCacheLookup (a, d);
+		if (i) {
+			if (i->inodeItem[0] == 0) number = a;
+			continue;
+		}
 		i = inodeLoad (a, d);
 		if (!i) break;
 		if (inodeGetBlockAddr(i, 0) == 0)
@@ -346,3 +754,149 @@ unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d) {
 	}
 	return number;
 }
+
+//Funcao que obtem da cache o i-node de numero number do disco d, carregando-o
+//do disco se necessario. O i-node retornado e' compartilhado por todos que o
+//obtiverem e deve ser devolvido com inodePut, nunca liberado com free.
+//Retorna NULL em caso de falha
+Inode* inodeGet (unsigned int number, Disk *d) {
+	if (number < 1 || !d) return NULL;
+	Inode *i = __inodeCacheLookup (number, d);
+	if (!i) {
+		if (inodeCacheCount >= INODE_CACHEMAX) __inodeCacheEvict ();
+		i = inodeLoad (number, d);
+		if (!i) return NULL;
+		i->number = number;
+		i->cached = 1;
+		i->hashNext = inodeCache[number % INODE_CACHEBUCKETS];
+		inodeCache[number % INODE_CACHEBUCKETS] = i;
+		inodeCacheCount++;
+	}
+	i->refs++;
+	return i;
+}
+
+//Funcao que devolve uma referencia a um i-node obtido com inodeGet. O i-node
+//permanece na cache, inclusive se sujo, ate ser despejado ou descartado
+void inodePut (Inode *i) {
+	if (!i) return;
+	if (!i->cached) __inodeFree (i);
+	else if (i->refs > 0) i->refs--;
+}
+
+//Funcao que marca um i-node como sujo, adiando sua gravacao em disco para
+//inodeWriteBack, inodeSync ou o despejo da cache
+void inodeMarkDirty (Inode *i) {
+	if (i) i->dirty = 1;
+}
+
+//Funcao que grava um i-node em disco se estiver sujo. Retorna 0 se bem
+//sucedido ou -1, caso contrario
+int inodeWriteBack (Inode *i) {
+	if (!i) return -1;
+	if (i->dirty && inodeSave (i) < 0) return -1;
+	return 0;
+}
+
+//Funcao que grava em disco todos os i-nodes sujos da cache pertencentes ao
+//disco d, ou de todos os discos se d for NULL, agrupando-os por setor com
+//inodeSaveBatch. Retorna 0 se bem sucedido ou -1 se algum i-node nao pode ser
+//gravado
+int inodeSync (Disk *d) {
+	unsigned int n = 0;
+	Inode **list = malloc ((inodeCacheCount + 1) * sizeof(Inode*));
+	if (!list) return -1;
+	for (int b = 0; b < INODE_CACHEBUCKETS; b++)
+		for (Inode *i = inodeCache[b]; i; i = i->hashNext)
+			if ((!d || i->d == d) && i->dirty)
+				list[n++] = i;
+	int ret = inodeSaveBatch (list, n);
+	free (list);
+	return ret;
+}
+
+//Funcao que descarta da cache os i-nodes sem referencias do disco d, ou de
+//todos os discos se d for NULL, sem grava-los, e as copias em memoria de seus
+//mapas de i-nodes livres, ja gravados em disco. Alteracoes pendentes devem
+//ser gravadas antes com inodeSync, se desejado
+void inodeCacheDrop (Disk *d) {
+	for (int b = 0; b < INODE_CACHEBUCKETS; b++) {
+		Inode **p = &inodeCache[b];
+		while (*p) {
+			Inode *i = *p;
+			if (i->refs == 0 && (!d || i->d == d)) {
+				*p = i->hashNext;
+				inodeCacheCount--;
+				__inodeFree (i);
+			}
+			else p = &i->hashNext;
+		}
+	}
+	if (d) __inodeBitmapDrop (d);
+	else while (inodeBitmaps) __inodeBitmapDrop (inodeBitmaps->d);
+}
+
+//Funcao que cria no disco d o mapa de i-nodes livres para numInodes i-nodes,
+//todos livres, gravando-o em disco e mantendo uma copia em memoria. Retorna 0
+//se bem sucedido ou -1, caso contrario
+int inodeBitmapCreate (Disk *d, unsigned int numInodes) {
+	if (!d || numInodes < 1 || numInodes > INODE_BITMAPMAX) return -1;
+	InodeBitmap *m = __inodeBitmapInit (d, numInodes);
+	if (!m) return -1;
+	if (__inodeBitmapSave (m) < 0) {
+		__inodeBitmapDrop (d);
+		return -1;
+	}
+	return 0;
+}
+
+//Funcao que carrega em memoria o mapa de i-nodes livres do disco d. Retorna 0
+//se bem sucedido ou -1 se o disco nao possuir mapa valido, caso em que
+//inodeFindFreeInode volta a examinar os i-nodes no disco
+int inodeBitmapLoad (Disk *d) {
+	unsigned char sector[DISK_SECTORDATASIZE];
+	unsigned int numInodes = 0;
+	if (!d) return -1;
+	__inodeBitmapDrop (d);
+	if (diskReadSector (d, INODE_BITMAPSECTOR, sector) < 0) return -1;
+	if (memcmp (sector, "IMAP", 4) != 0) return -1;
+	char2ul (&sector[4], &numInodes);
+	if (numInodes < 1 || numInodes > INODE_BITMAPMAX) return -1;
+	InodeBitmap *m = __inodeBitmapInit (d, numInodes);
+	if (!m) return -1;
+	for (unsigned int b = 0; b < numInodes; b++)
+		if (sector[INODE_BITMAPHEADER + b / 8] & (1 << (b % 8)))
+			m->words[b / 64] |= 1ULL << (b % 64);
+	while (m->firstFree < INODE_BITMAPWORDS &&
+	       m->words[m->firstFree] == ~0ULL)
+		m->firstFree++;
+	return 0;
+}
+
+//Funcao que marca como livre, no mapa de i-nodes livres do disco d, o i-node
+//de numero number, gravando o mapa em disco. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeFreeInode (unsigned int number, Disk *d) {
+	InodeBitmap *m = __inodeBitmapLookup (d);
+	if (!m || number < 1 || number > m->numInodes) return -1;
+	unsigned int b = number - 1;
+	unsigned long long bit = m->words[b / 64] & (1ULL << (b % 64));
+	m->words[b / 64] &= ~(1ULL << (b % 64));
+	if (__inodeBitmapSave (m) < 0) {
+		m->words[b / 64] |= bit;
+		return -1;
+	}
+	if (b / 64 < m->firstFree) m->firstFree = b / 64;
+	return 0;
+}
+
+//Funcao que retorna o numero de i-nodes livres do disco d segundo seu mapa de
+//i-nodes livres, ou 0 se o mapa nao estiver carregado
+unsigned int inodeNumFreeInodes (Disk *d) {
+	InodeBitmap *m = __inodeBitmapLookup (d);
+	unsigned int used = 0;
+	if (!m) return 0;
+	for (unsigned int w = 0; w < INODE_BITMAPWORDS; w++)
+		used += __builtin_popcountll (m->words[w]);
+	return INODE_BITMAPWORDS * 64 - used;
+}
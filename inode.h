@@ -44,6 +44,18 @@ int inodeClear (Inode *i);
 //i-nodes por setor pode variar de acordo com o tamanho do tipo unsigned int
 int inodeSave (Inode *i);
 
+//Funcao que persiste em disco os n i-nodes de list, agrupando-os por setor.
+//Cada setor e' gravado uma unica vez com todas as suas alteracoes, e so e' lido
+//antes se nem todos os seus i-nodes estiverem em list. Setores contiguos sao
+//gravados juntos. Retorna 0 se bem sucedido ou -1, caso contrario
+int inodeSaveBatch (Inode **list, unsigned int n);
+
+//Funcao que cria count i-nodes vazios, de numeros first a first+count-1,
+//gravando-os em lote com inodeSaveBatch. Copias em cache desses i-nodes
+//passam a refletir o conteudo vazio. Retorna 0 se bem sucedido ou -1, caso
+//contrario
+int inodeCreateRange (unsigned int first, unsigned int count, Disk *d);
+
 //Funcao que recupera um i-node a partir do disco. Retorna ponteiro para o
 //i-node lido ou NULL em caso de falha.
 Inode* inodeLoad (unsigned int number, Disk *d);
@@ -68,7 +80,9 @@ void inodeSetRefCount (Inode *i, unsigned int refCount);
 
 //Funcao que adiciona um endereco ao fim do array de blocos de um i-node
 //Retorna -1 caso a inclusao do endereco nao seja bem sucedida
-//E' a unica funcao que salva automaticamente o i-node em disco
+//E' a unica funcao que salva automaticamente o i-node em disco. Apenas o
+//elemento alterado da cadeia e' gravado: a ultima extensao e quantos blocos
+//ela possui sao mantidos no i-node, sem percorrer a cadeia a cada inclusao
 int inodeAddBlock (Inode *i, unsigned int blockAddr);
 
 //Funcao que retorna o numero de um i-node.
@@ -97,11 +111,66 @@ unsigned int inodeGetRefCount (Inode *i);
 
 //Funcao que retorna o endereco correspondente a um bloco (blockNum) no array
 //de blocos de um i-node. O i-node precisa ser o primeiro de sua cadeia.
-//Retorna 0 se o bloco nao possuir endereco em blockNum
+//Retorna 0 se o bloco nao possuir endereco em blockNum. Para i-nodes obtidos
+//com inodeGet, blocos alem do i-node sao resolvidos por um mapa de blocos
+//construido no primeiro acesso, sem novas leituras da cadeia de extensoes
 unsigned int inodeGetBlockAddr (Inode *i, unsigned int blockNum);
 
 //Funcao que encontra um i-node livre em um disco, a partir do i-node de numero
 //startFrom. Retorna o numero do inode livre encontrado ou 0 se nao encontrado.
+//Se o mapa de i-nodes livres do disco estiver carregado, a busca e' feita nele,
+//uma palavra de 64 i-nodes por vez, e o i-node encontrado e' marcado como em
+//uso, com o mapa gravado em disco. Caso contrario, os i-nodes sao lidos um a
+//um e e' considerado livre o que nao possuir bloco
 unsigned int inodeFindFreeInode (unsigned int startFrom, Disk *d);
 
+//Funcao que obtem da cache o i-node de numero number do disco d, carregando-o
+//do disco se necessario. O i-node retornado e' compartilhado por todos que o
+//obtiverem e deve ser devolvido com inodePut, nunca liberado com free.
+//Retorna NULL em caso de falha
+Inode* inodeGet (unsigned int number, Disk *d);
+
+//Funcao que devolve uma referencia a um i-node obtido com inodeGet. O i-node
+//permanece na cache, inclusive se sujo, ate ser despejado ou descartado
+void inodePut (Inode *i);
+
+//Funcao que marca um i-node como sujo, adiando sua gravacao em disco para
+//inodeWriteBack, inodeSync ou o despejo da cache
+void inodeMarkDirty (Inode *i);
+
+//Funcao que grava um i-node em disco se estiver sujo. Retorna 0 se bem
+//sucedido ou -1, caso contrario
+int inodeWriteBack (Inode *i);
+
+//Funcao que grava em disco todos os i-nodes sujos da cache pertencentes ao
+//disco d, ou de todos os discos se d for NULL, agrupando-os por setor com
+//inodeSaveBatch. Retorna 0 se bem sucedido ou -1 se algum i-node nao pode ser
+//gravado
+int inodeSync (Disk *d);
+
+//Funcao que descarta da cache os i-nodes sem referencias do disco d, ou de
+//todos os discos se d for NULL, sem grava-los, e as copias em memoria de seus
+//mapas de i-nodes livres, ja gravados em disco. Alteracoes pendentes devem
+//ser gravadas antes com inodeSync, se desejado
+void inodeCacheDrop (Disk *d);
+
+//Funcao que cria no disco d o mapa de i-nodes livres para numInodes i-nodes,
+//todos livres, gravando-o em disco e mantendo uma copia em memoria. Retorna 0
+//se bem sucedido ou -1, caso contrario
+int inodeBitmapCreate (Disk *d, unsigned int numInodes);
+
+//Funcao que carrega em memoria o mapa de i-nodes livres do disco d. Retorna 0
+//se bem sucedido ou -1 se o disco nao possuir mapa valido, caso em que
+//inodeFindFreeInode volta a examinar os i-nodes no disco
+int inodeBitmapLoad (Disk *d);
+
+//Funcao que marca como livre, no mapa de i-nodes livres do disco d, o i-node
+//de numero number, gravando o mapa em disco. Retorna 0 se bem sucedido ou -1,
+//caso contrario
+int inodeFreeInode (unsigned int number, Disk *d);
+
+//Funcao que retorna o numero de i-nodes livres do disco d segundo seu mapa de
+//i-nodes livres, ou 0 se o mapa nao estiver carregado
+unsigned int inodeNumFreeInodes (Disk *d);
+
 #endif
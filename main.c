@@ -45,14 +45,25 @@ unsigned int fdc = 0;	//Numero de descritores de arquivos abertos
 void doDiskBuild() {
 	char rawDiskPath[MAX_FILENAME_LENGTH+1];
 	unsigned long numCylinders;
+	char format;
+	int result;
 	printf ("\n>> Build: Raw disk file (e.g. 1024cyl.dsk): ");
 	scanf (" %s", rawDiskPath);
 	printf (">> Build: Number of cylinders (0: cancel): ");
 	scanf (" %lu", &numCylinders);
 	if (!numCylinders) return;
+	printf (">> Build: Raw disk format ([F]ramed, [S]parse framed, "
+	        "[A]ligned): ");
+	scanf (" %c", &format);
 	printf ("\n-- Building... "); fflush (stdout);
 
-	if ( diskCreateRawDisk (rawDiskPath, numCylinders) != -1 )
+	if (format == 'S' || format == 's')
+		result = diskCreateRawDiskSparse (rawDiskPath, numCylinders);
+	else if (format == 'A' || format == 'a')
+		result = diskCreateRawDiskAligned (rawDiskPath, numCylinders);
+	else
+		result = diskCreateRawDisk (rawDiskPath, numCylinders);
+	if ( result != -1 )
 		printf ("Disk %s successfully (re)built\n", rawDiskPath);
 	else
 		printf ("\n!! Build: FAILED. No permission or not enough "
@@ -62,6 +73,33 @@ void doDiskBuild() {
 }
 
 
+//Interface para converter o arquivo de um disco, nao conectado ao sistema
+//hipotetico, para outro formato de disco fisico
+void doDiskConvert (void) {
+	char srcPath[MAX_FILENAME_LENGTH+1], dstPath[MAX_FILENAME_LENGTH+1];
+	char format;
+	printf ("\n>> Convert: Source raw disk file (e.g. 1024cyl.dsk): ");
+	scanf (" %s", srcPath);
+	printf (">> Convert: Destination raw disk file: ");
+	scanf (" %s", dstPath);
+	printf (">> Convert: Destination format ([F]ramed, [A]ligned): ");
+	scanf (" %c", &format);
+	printf ("\n-- Converting... "); fflush (stdout);
+
+	if ( strcmp (srcPath, dstPath) != 0 &&
+	     diskConvertRawDisk (srcPath, dstPath,
+	                         (format == 'A' || format == 'a'
+	                          ? DISK_FORMATALIGNED
+	                          : DISK_FORMATFRAMED)) != -1 )
+		printf ("Disk %s successfully converted to %s\n", srcPath,
+		        dstPath);
+	else
+		printf ("\n!! Convert: FAILED. No such file, same source "
+		        "and destination or not enough free space\n");
+
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para conectar um disco existente ao sistema operacional hipotetico
 void doDiskConnect(char *rawDiskPath) {
 	if ( connectedDisks == MAX_CONNECTEDDISKS )
@@ -86,6 +124,8 @@ void doDiskConnect(char *rawDiskPath) {
 		printf ("\n-- Connecting... "); fflush (stdout);
 		disks[id] = diskConnect (id, rawDiskPath);
 		if (disks[id]) {
+			//A simulacao interativa mantem os atrasos reais
+			diskSetRealTime (disks[id], 1);
 			printf ("Disk %s successfully connected\n",
 			        rawDiskPath);
 			connectedDisks++;
@@ -101,6 +141,101 @@ void doDiskConnect(char *rawDiskPath) {
 	SLEEP (RESULT_MSGDELAY);
 }
 
+//Interface para conectar ao sistema operacional hipotetico um volume
+//distribuido (RAID-0) formado por discos existentes
+void doDiskConnectStriped (void) {
+	if ( connectedDisks == MAX_CONNECTEDDISKS )
+		printf ("\n!! DiskConnect: FAILED. "
+		        "Maximum number of connected disks reached!\n");
+	else {
+		int id = -1;
+		unsigned int numMembers;
+		unsigned long stripeUnit;
+		char **rawDiskPaths;
+		for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+			if (!disks[a]) { 
+				id = a;
+				break;
+			}
+		printf ("\n>> DiskConnect: Number of member disks "
+		        "(0: cancel): ");
+		scanf (" %u", &numMembers);
+		if (!numMembers) return;
+		rawDiskPaths = malloc (numMembers * sizeof (char*));
+		for (unsigned int m = 0; m < numMembers; m++) {
+			rawDiskPaths[m] = malloc (sizeof (
+			                          char[MAX_FILENAME_LENGTH+1]));
+			printf (">> DiskConnect: Raw disk file of member %u "
+			        "(e.g. 1024cyl.dsk): ", m);
+			scanf (" %s", rawDiskPaths[m]);
+		}
+		printf (">> DiskConnect: Stripe unit in # of sectors: ");
+		scanf (" %lu", &stripeUnit);
+		printf ("\n-- Connecting... "); fflush (stdout);
+		disks[id] = diskConnectStriped (id, rawDiskPaths, numMembers,
+		                                stripeUnit);
+		if (disks[id]) {
+			diskSetRealTime (disks[id], 1);
+			printf ("Striped volume of %u disks successfully "
+			        "connected\n", numMembers);
+			connectedDisks++;
+		}
+		else
+			printf ("\n!! DiskConnect: FAILED. No such file, "
+			        "file is inaccessible/corrupted or invalid "
+			        "stripe unit\n");
+		for (unsigned int m = 0; m < numMembers; m++)
+			free (rawDiskPaths[m]);
+		free (rawDiskPaths);
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para conectar um volume espelhado (RAID-1) ao sistema
+//operacional hipotetico
+void doDiskConnectMirrored (void) {
+	if ( connectedDisks == MAX_CONNECTEDDISKS )
+		printf ("\n!! DiskConnect: FAILED. "
+		        "Maximum number of connected disks reached!\n");
+	else {
+		int id = -1;
+		unsigned int numMembers;
+		char **rawDiskPaths;
+		for (int a=0; a<MAX_CONNECTEDDISKS; a++)
+			if (!disks[a]) { 
+				id = a;
+				break;
+			}
+		printf ("\n>> DiskConnect: Number of member disks "
+		        "(0: cancel): ");
+		scanf (" %u", &numMembers);
+		if (!numMembers) return;
+		rawDiskPaths = malloc (numMembers * sizeof (char*));
+		for (unsigned int m = 0; m < numMembers; m++) {
+			rawDiskPaths[m] = malloc (sizeof (
+			                          char[MAX_FILENAME_LENGTH+1]));
+			printf (">> DiskConnect: Raw disk file of member %u "
+			        "(e.g. 1024cyl.dsk): ", m);
+			scanf (" %s", rawDiskPaths[m]);
+		}
+		printf ("\n-- Connecting... "); fflush (stdout);
+		disks[id] = diskConnectMirrored (id, rawDiskPaths, numMembers);
+		if (disks[id]) {
+			diskSetRealTime (disks[id], 1);
+			printf ("Mirrored volume of %u disks successfully "
+			        "connected\n", numMembers);
+			connectedDisks++;
+		}
+		else
+			printf ("\n!! DiskConnect: FAILED. No such file or "
+			        "file is inaccessible/corrupted\n");
+		for (unsigned int m = 0; m < numMembers; m++)
+			free (rawDiskPaths[m]);
+		free (rawDiskPaths);
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para listar dados dos discos atualmente conectados ao sistema
 //operacional hipotetico
 void doDiskList (void) {
@@ -109,15 +244,272 @@ void doDiskList (void) {
 	else {
 		printf ("\n-- DiskList: Listing...\n");
 		for (int id = 0; id<MAX_CONNECTEDDISKS; id++) {
+			DiskStats st;
+			unsigned long hotCyl = 0;
+			if (!disks[id]) continue;
 			printf ("-- DiskID: %d; NumCylinders: %lu; "
 			        "DataSize: %lu\n",
 				id, diskGetNumCylinders(disks[id]),
 				diskGetSize(disks[id]));
+			diskGetStats (disks[id], &st);
+			//A entrada numCylinders e' a de um cilindro final parcial,
+			//com calor 0 se o disco nao tiver um
+			for (unsigned long c = 1;
+			     c <= diskGetNumCylinders(disks[id]); c++)
+				if (diskGetCylinderHeat (disks[id], c) >
+				    diskGetCylinderHeat (disks[id], hotCyl))
+					hotCyl = c;
+			printf ("   Sectors read: %lu; Sectors written: %lu; "
+			        "Seeks: %lu; Cylinders traversed: %lu\n",
+			        st.sectorsRead, st.sectorsWritten,
+			        st.numSeeks, st.cylindersTraversed);
+			printf ("   Cache: %u sectors; Hits: %lu; Misses: %lu\n",
+			        diskGetCacheCapacity(disks[id]),
+			        st.cacheHits, st.cacheMisses);
+			printf ("   Checksum errors: %lu; Verify on read: %s\n",
+			        st.checksumErrors,
+			        (diskGetVerifyOnRead(disks[id]) ? "on" : "off"));
+			printf ("   Track buffer: %s; Hits: %lu\n",
+			        (diskGetTrackBuffer(disks[id]) ? "on" : "off"),
+			        st.trackHits);
+			printf ("   Queue latency (class: requests, avg/max us):");
+			for (int c = 0; c < DISK_PRIOCLASSES; c++)
+				printf (" %d: %lu, %lu/%lu", c, st.prioRequests[c],
+				        (st.prioRequests[c] ? st.prioLatency[c]
+				         / st.prioRequests[c] : 0UL),
+				        st.prioMaxLatency[c]);
+			printf ("; Promoted: %lu\n", st.prioPromoted);
+			printf ("   Seek distances (cylinders: accesses):");
+			for (int b = 0; b < DISK_SEEKHISTBUCKETS; b++)
+				if (st.seekHist[b])
+					printf (" %lu+: %lu", 
+					        (b ? 1UL << (b-1) : 0UL),
+					        st.seekHist[b]);
+			printf ("\n   Hottest cylinder: %lu (%lu sectors)\n",
+			        hotCyl, diskGetCylinderHeat(disks[id],
+			                                    hotCyl));
 		}
 	}
 	SLEEP(RESULT_MSGDELAY);
 }
 
+//Interface para exportar as estatisticas de uso de um disco conectado ao
+//sistema operacional hipotetico para um arquivo CSV
+void doDiskStatsExport (void) {
+	if ( !connectedDisks )
+		printf ("\n!! DiskStats: No connected disks!\n");
+	else {
+		int id;
+		char csvPath[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> DiskStats: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! DiskStats: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			printf (">> DiskStats: CSV file (e.g. disk0.csv): ");
+			scanf (" %s", csvPath);
+			printf ("\n-- Exporting... "); fflush (stdout);
+			if ( diskDumpStatsCSV (disks[id], csvPath) == 0 )
+				printf ("Statistics of disk %d written to "
+				        "%s\n", id, csvPath);
+			else
+				printf ("\n!! DiskStats: FAILED. Cannot "
+				        "write the CSV file!\n");
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para ligar ou desligar o rastreamento de E/S de um disco conectado
+//ao sistema operacional hipotetico
+void doDiskTrace (void) {
+	if ( !connectedDisks )
+		printf ("\n!! DiskTrace: No connected disks!\n");
+	else {
+		int id;
+		char tracePath[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> DiskTrace: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! DiskTrace: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			printf (">> DiskTrace: Trace file (e.g. disk0.trc; "
+			        "-: stop tracing): ");
+			scanf (" %s", tracePath);
+			if ( strcmp (tracePath, "-") == 0 ) {
+				if ( diskTraceStop (disks[id]) == 0 )
+					printf ("\n-- Tracing of disk %d "
+					        "stopped\n", id);
+				else
+					printf ("\n!! DiskTrace: FAILED. "
+					        "Cannot write the trace "
+					        "file!\n");
+			}
+			else if ( diskTraceStart (disks[id], tracePath) == 0 )
+				printf ("\n-- Tracing I/O of disk %d to %s\n",
+				        id, tracePath);
+			else
+				printf ("\n!! DiskTrace: FAILED. Cannot "
+				        "create the trace file!\n");
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para reproduzir um rastreamento de E/S sobre um disco conectado ao
+//sistema operacional hipotetico, informando o tempo modelado
+void doDiskTraceReplay (void) {
+	if ( !connectedDisks )
+		printf ("\n!! DiskReplay: No connected disks!\n");
+	else {
+		int id;
+		char tracePath[MAX_FILENAME_LENGTH+1];
+		printf ("\n>> DiskReplay: Disk ID (its sectors will be "
+		        "overwritten): ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! DiskReplay: FAILED. "
+			        "Invalid identifier!\n");
+		else if (disks[id] == rd) 
+			printf ("\n!! DiskReplay: FAILED. Cannot replay "
+			        "on the root filesystem disk\n");
+		else {
+			unsigned int batch, cacheSectors;
+			int realTime;
+			DiskReplayResult res;
+			printf (">> DiskReplay: Trace file (e.g. disk0.trc): ");
+			scanf (" %s", tracePath);
+			printf (">> DiskReplay: Scheduler batch in # of sectors "
+			        "(0: arrival order): ");
+			scanf (" %u", &batch);
+			printf (">> DiskReplay: Cache size in # of sectors "
+			        "(0: no cache): ");
+			scanf (" %u", &cacheSectors);
+			printf ("\n-- Replaying... "); fflush (stdout);
+			//A reproducao mede o tempo modelado, sem atrasos reais
+			realTime = diskGetRealTime (disks[id]);
+			diskSetRealTime (disks[id], 0);
+			if ( diskSetCacheCapacity (disks[id],
+			                           cacheSectors) < 0 ||
+			     diskTraceReplay (disks[id], tracePath, batch,
+			                      &res) < 0 )
+				printf ("\n!! DiskReplay: FAILED. No such file, "
+				        "invalid trace or operation "
+				        "failed!\n");
+			else
+				printf ("%lu operations (%lu sectors, %lu "
+				        "failed) replayed\n"
+				        "-- Modelled time: %lu us; Traced "
+				        "time: %lu us\n", res.requests,
+				        res.sectors, res.failed, res.simTime,
+				        res.traceTime);
+			diskSetRealTime (disks[id], realTime);
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para ligar ou desligar o buffer de trilha de um disco conectado ao
+//sistema operacional hipotetico
+void doDiskTrackBuffer (void) {
+	if ( !connectedDisks )
+		printf ("\n!! TrackBuffer: No connected disks!\n");
+	else {
+		int id;
+		printf ("\n>> TrackBuffer: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! TrackBuffer: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			int enabled = !diskGetTrackBuffer (disks[id]);
+			if ( diskSetTrackBuffer (disks[id], enabled) == 0 )
+				printf ("\n-- Track buffer of disk %d is now "
+				        "%s\n", id, (enabled ? "on" : "off"));
+			else
+				printf ("\n!! TrackBuffer: FAILED. Not enough "
+				        "memory!\n");
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para escolher o modelo de latencia e o escalonador de um disco
+//conectado ao sistema operacional hipotetico
+void doDiskLatency (void) {
+	if ( !connectedDisks )
+		printf ("\n!! DiskLatency: No connected disks!\n");
+	else {
+		int id;
+		printf ("\n>> DiskLatency: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! DiskLatency: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			DiskLatencyModel m;
+			char model, sched;
+			printf (">> DiskLatency: Model "
+			        "(L=linear, R=rotational): ");
+			scanf (" %c", &model);
+			printf (">> DiskLatency: Scheduler (C=C-LOOK, S=SPTF): ");
+			scanf (" %c", &sched);
+			if ( diskGetLatencyPreset ((model == 'R' || model == 'r'
+			                            ? DISK_LATENCYROTATIONAL
+			                            : DISK_LATENCYLINEAR), &m) < 0
+			     || diskSetScheduler (disks[id], (sched == 'S'
+			                          || sched == 's'
+			                          ? DISK_SCHEDSPTF
+			                          : DISK_SCHEDCLOOK)) < 0 )
+				printf ("\n!! DiskLatency: FAILED.\n");
+			else {
+				diskSetLatencyModel (disks[id], &m);
+				printf ("\n-- Disk %d now uses the %s model with "
+				        "%s scheduling\n", id,
+				        (m.rotationTime ? "rotational" : "linear"),
+				        (diskGetScheduler (disks[id])
+				         == DISK_SCHEDSPTF ? "SPTF" : "C-LOOK"));
+			}
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
+//Interface para verificar as somas de todos os setores de um disco conectado
+//ao sistema operacional hipotetico
+void doDiskScrub (void) {
+	if ( !connectedDisks )
+		printf ("\n!! DiskScrub: No connected disks!\n");
+	else {
+		int id;
+		printf ("\n>> DiskScrub: Disk ID: ");
+		scanf (" %u", &id);
+		if ( id > MAX_CONNECTEDDISKS - 1 || !disks[id])
+			printf ("\n!! DiskScrub: FAILED. "
+			        "Invalid identifier!\n");
+		else {
+			unsigned long bad[8];
+			long numBad;
+			printf ("\n-- Scrubbing... "); fflush (stdout);
+			numBad = diskScrub (disks[id], 0,
+			                    diskGetNumSectors(disks[id]),
+			                    bad, 8);
+			if ( numBad < 0 )
+				printf ("\n!! DiskScrub: FAILED. Cannot read "
+				        "the disk!\n");
+			else {
+				printf ("%ld sectors with bad checksums\n",
+				        numBad);
+				for (long i = 0; i < numBad && i < 8; i++)
+					printf ("-- Bad sector #%lu\n", bad[i]);
+			}
+		}
+	}
+	SLEEP (RESULT_MSGDELAY);
+}
+
 //Interface para mostrar na saida padrao o conteudo de uma faixa de setores de
 //um disco conectado ao sistema operacional hipotetico
 void doDiskReadPrintSectors (void) {
@@ -675,9 +1067,18 @@ void diskMenuSelection (void) {
 		printf ("\nDISK operations:                        "
 			  "               Disks: %u / Root Disk: %d\n"
 		          "     [B]uild/rebuild a disk (Low-level format)\n"
+		          "     con[V]ert a raw disk file format\n"
 		          "     [C]onnect a disk\n"
+		          "     [S]triped volume connect (RAID-0)\n"
+		          "     m[I]rrored volume connect (RAID-1)\n"
 			  "     [L]ist connected disks\n"
 			  "     [R]ead/print sector range from a disk\n"
+			  "     scr[U]b a disk (verify sector checksums)\n"
+			  "     trac[K] buffer on/off\n"
+			  "     latency [M]odel and scheduler\n"
+			  "     [E]xport disk statistics (CSV)\n"
+			  "     [T]race disk I/O (start/stop)\n"
+			  "     re[P]lay a disk I/O trace\n"
 		          "     [D]isconnect a disk\n"
 		          "     [<]back to MAIN menu\n"
 		          "\n>> Your selection: ", connectedDisks,
@@ -686,9 +1087,18 @@ void diskMenuSelection (void) {
 		scanf (" %c", &choice);
 		switch (choice) {
 			case 'B': case 'b': doDiskBuild(); break;
+			case 'V': case 'v': doDiskConvert(); break;
 			case 'C': case 'c': doDiskConnect(NULL); break;
+			case 'S': case 's': doDiskConnectStriped(); break;
+			case 'I': case 'i': doDiskConnectMirrored(); break;
 			case 'L': case 'l': doDiskList(); break;
 			case 'R': case 'r': doDiskReadPrintSectors(); break;
+			case 'U': case 'u': doDiskScrub(); break;
+			case 'K': case 'k': doDiskTrackBuffer(); break;
+			case 'M': case 'm': doDiskLatency(); break;
+			case 'E': case 'e': doDiskStatsExport(); break;
+			case 'T': case 't': doDiskTrace(); break;
+			case 'P': case 'p': doDiskTraceReplay(); break;
 			case 'D': case 'd': doDiskDisconnect(NO_ID); break;
 		}
 	}
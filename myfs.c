@@ -27,6 +27,7 @@ typedef struct {
   unsigned int inumber;
   unsigned int cursor;
   Disk *disk;
+  Inode *inode; // I-node do arquivo, obtido da cache de i-nodes
 } FileDescriptor;
 
 typedef struct {
@@ -63,6 +64,7 @@ static void initFileDescriptors() {
       openFiles[i].inumber = 0;
       openFiles[i].cursor = 0;
       openFiles[i].disk = NULL;
+      openFiles[i].inode = NULL;
     }
     initialized = 1;
   }
@@ -85,11 +87,9 @@ static int writeBlock(Disk *d, unsigned long int firstSector,
                       unsigned int blockSize, const unsigned char *in) {
   unsigned int sectorsPerBlock = blockSize / DISK_SECTORDATASIZE;
 
-  for (unsigned int i = 0; i < sectorsPerBlock; i++) {
-    if (diskWriteSector(d, firstSector + i,
-                        (unsigned char *)(in + (i * DISK_SECTORDATASIZE))) != 0)
-      return -1;
-  }
+  if (diskWriteSectors(d, firstSector, sectorsPerBlock,
+                       (unsigned char *)in) != 0)
+    return -1;
   return 0;
 }
 
@@ -97,11 +97,8 @@ static int readBlock(Disk *d, unsigned long int firstSector,
                      unsigned int blockSize, unsigned char *out) {
   unsigned int sectorsPerBlock = blockSize / DISK_SECTORDATASIZE;
 
-  for (unsigned int i = 0; i < sectorsPerBlock; i++) {
-    if (diskReadSector(d, firstSector + i, out + (i * DISK_SECTORDATASIZE)) !=
-        0)
-      return -1;
-  }
+  if (diskReadSectors(d, firstSector, sectorsPerBlock, out) != 0)
+    return -1;
   return 0;
 }
 
@@ -118,6 +115,15 @@ static int readSuperBlock(Disk *d, SuperBlock *sb) {
   return 0;
 }
 
+// Verifica se um setor esta em branco, como um setor nunca gravado ou
+// descartado do disco
+static int isBlankSector(const unsigned char *sector) {
+  for (int i = 0; i < DISK_SECTORDATASIZE; i++)
+    if (sector[i] != ' ')
+      return 0;
+  return 1;
+}
+
 static unsigned long int allocateFreeCluster(Disk *d, SuperBlock *sb) {
   if (sb->firstFreeClusterAddress == 0)
     return 0;
@@ -130,7 +136,17 @@ static unsigned long int allocateFreeCluster(Disk *d, SuperBlock *sb) {
 
   FreeClusterHeader hdr;
   memset(&hdr, 0, sizeof(hdr));
-  memcpy(&hdr.nextClusterAddress, sector0, sizeof(unsigned long int));
+  if (isBlankSector(sector0)) {
+    // Cluster nunca gravado desde a formatacao: o proximo livre e' o
+    // cluster seguinte, ate o fim da area de dados
+    unsigned int sectorsPerCluster = sb->blockSize / DISK_SECTORDATASIZE;
+    unsigned long int dataEnd =
+        sb->dataBeginSector + (sb->dataLastCluster + 1) * sectorsPerCluster;
+    if (allocated + sectorsPerCluster < dataEnd)
+      hdr.nextClusterAddress = allocated + sectorsPerCluster;
+  } else {
+    memcpy(&hdr.nextClusterAddress, sector0, sizeof(unsigned long int));
+  }
 
   sb->firstFreeClusterAddress = hdr.nextClusterAddress;
 
@@ -144,6 +160,26 @@ static unsigned long int allocateFreeCluster(Disk *d, SuperBlock *sb) {
   return allocated;
 }
 
+// Devolve ao inicio da lista de clusters livres o cluster que comeca no setor
+// addr, gravando o superbloco. O primeiro setor do cluster guarda o
+// encadeamento e os demais sao descartados, liberando seu espaco no arquivo
+// do disco
+static int releaseCluster(Disk *d, SuperBlock *sb, unsigned long int addr) {
+  unsigned int sectorsPerCluster = sb->blockSize / DISK_SECTORDATASIZE;
+  unsigned char sector0[DISK_SECTORDATASIZE];
+
+  memset(sector0, 0, sizeof(sector0));
+  memcpy(sector0, &sb->firstFreeClusterAddress, sizeof(unsigned long int));
+  if (diskWriteSector(d, addr, sector0) != 0)
+    return -1;
+  if (sectorsPerCluster > 1 &&
+      diskDiscardSectors(d, addr + 1, sectorsPerCluster - 1) != 0)
+    return -1;
+
+  sb->firstFreeClusterAddress = addr;
+  return writeSuperBlock(d, sb);
+}
+
 // Funcao para verificacao se o sistema de arquivos está ocioso, ou seja,
 // se nao ha quisquer descritores de arquivos em uso atualmente. Retorna
 // um positivo se ocioso ou, caso contrario, 0.
@@ -165,7 +201,8 @@ int myFSFormat(Disk *d, unsigned int blockSize) {
   printf("\n-- Formatting disk %d...", diskGetId(d));
   printf("\n   Block size: %u bytes", blockSize);
   printf("\n   Disk size: %lu bytes", diskGetSize(d));
-  SLEEP(1000);
+  if (diskGetRealTime(d))
+    SLEEP(1000);
 
   if (!d) {
     printf("\n!! Error: Invalid disk pointer (NULL). Disk ID: %d\n",
@@ -186,6 +223,9 @@ int myFSFormat(Disk *d, unsigned int blockSize) {
     return -1;
   }
 
+  // I-nodes em cache deste disco sao invalidados pela formatacao
+  inodeCacheDrop(d);
+
   unsigned long totalSectors = diskGetNumSectors(d);
   unsigned long diskSize = diskGetSize(d);
 
@@ -254,21 +294,13 @@ int myFSFormat(Disk *d, unsigned int blockSize) {
   }
 
   printf("\n-- Initializing data sectors and free list...");
-  for (unsigned long i = dataBeginSector; i < totalSectors; i++) {
-    unsigned char emptySector[DISK_SECTORDATASIZE] = {0};
-
-    if ((i - dataBeginSector) % sectorsPerCluster == 0) {
-      FreeClusterHeader header;
-      header.nextClusterAddress = i + sectorsPerCluster;
-      memcpy(emptySector, &header.nextClusterAddress,
-             sizeof(unsigned long int));
-    }
-
-    if (diskWriteSector(d, i, emptySector) != 0) {
-      printf("\n!! Error: Failed to write data sector %lu. Disk ID: %d\n", i,
-             diskGetId(d));
-      return -1;
-    }
+  // A area de dados e' descartada: clusters em branco encadeiam-se
+  // implicitamente ao seguinte na lista de livres (ver allocateFreeCluster)
+  if (diskDiscardSectors(d, dataBeginSector,
+                         totalSectors - dataBeginSector) != 0) {
+    printf("\n!! Error: Failed to discard data sectors. Disk ID: %d\n",
+           diskGetId(d));
+    return -1;
   }
 
   printf("\n-- Writing superblock...");
@@ -290,14 +322,22 @@ int myFSFormat(Disk *d, unsigned int blockSize) {
   }
 
   printf("\n-- Creating %d empty inodes...", numInodes);
-  for (unsigned int i = 0; i < numInodes; i++) {
-    Inode *inode = inodeCreate(i + 1, d);
-    if (inode == NULL) {
-      printf("\n!! Error: Failed to create inode %u. Disk ID: %d\n", i + 1,
-             diskGetId(d));
-      return -1;
-    }
-    free(inode);
+  // Os i-nodes sao gravados em lote, um setor de cada vez
+  if (inodeCreateRange(1, numInodes, d) != 0) {
+    printf("\n!! Error: Failed to create inodes. Disk ID: %d\n", diskGetId(d));
+    return -1;
+  }
+
+  // Mapa de i-nodes livres, no setor entre o superbloco e os i-nodes, com o
+  // i-node raiz ja' alocado. A copia em memoria e' descartada: a montagem
+  // volta a carrega-la, e o disco pode ser desconectado antes disso
+  int bitmapOk = inodeBitmapCreate(d, numInodes) == 0 &&
+                 inodeFindFreeInode(ROOT_INODE, d) == ROOT_INODE;
+  inodeCacheDrop(d);
+  if (!bitmapOk) {
+    printf("\n!! Error: Failed to create inode bitmap. Disk ID: %d\n",
+           diskGetId(d));
+    return -1;
   }
 
   printf("\n-- Creating root directory...");
@@ -368,12 +408,21 @@ int myFSxMount(Disk *d, int x) {
     sbNumInodes = nin;
     sbFirstDataSector = fds;
     sbTotalBlocks = tb;
+    // Discos sem mapa de i-nodes livres continuam montaveis: a busca por
+    // i-nodes livres volta a examinar os i-nodes no disco
+    inodeBitmapLoad(d);
     myfsMounted = 1;
     initFileDescriptors();
     return 1;
   } else if (x == 0) {
     if (!myfsMounted)
       return 0;
+    // Grava os i-nodes sujos e esvazia a cache antes de persistir o disco
+    if (inodeSync(d) != 0)
+      return 0;
+    inodeCacheDrop(d);
+    if (diskFlush(d) != 0)
+      return 0;
     myfsMounted = 0;
     sbBlockSize = sbNumInodes = sbFirstDataSector = sbTotalBlocks = 0;
     return 1;
@@ -385,18 +434,18 @@ int myFSxMount(Disk *d, int x) {
 static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int *outInumber) {
   if (!d || !sb || !name || !outInumber) return -1;
 
-  Inode *root = inodeLoad(ROOT_INODE, d);
+  Inode *root = inodeGet(ROOT_INODE, d);
   if (!root) return -1;
 
   unsigned int dirSize = inodeGetFileSize(root);
-  if (dirSize == 0) { free(root); return 0; }
+  if (dirSize == 0) { inodePut(root); return 0; }
 
   const unsigned int entrySize = (unsigned int)sizeof(DirEntry);
-  if (entrySize == 0) { free(root); return -1; }
+  if (entrySize == 0) { inodePut(root); return -1; }
 
   unsigned int blockSize = sb->blockSize;
   unsigned char *blockBuf = (unsigned char*)malloc(blockSize);
-  if (!blockBuf) { free(root); return -1; }
+  if (!blockBuf) { inodePut(root); return -1; }
 
   unsigned int offset = 0;
   while (offset + entrySize <= dirSize) {
@@ -404,10 +453,10 @@ static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int
     unsigned int offInBlock = offset % blockSize;
 
     unsigned long int blockAddr = inodeGetBlockAddr(root, blockIndex);
-    if (blockAddr == 0) { free(blockBuf); free(root); return -1; }
+    if (blockAddr == 0) { free(blockBuf); inodePut(root); return -1; }
 
     if (readBlock(d, blockAddr, blockSize, blockBuf) != 0) {
-      free(blockBuf); free(root); return -1;
+      free(blockBuf); inodePut(root); return -1;
     }
 
     DirEntry ent;
@@ -419,9 +468,9 @@ static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int
       memcpy(&ent, blockBuf + offInBlock, part1);
 
       unsigned long int nextAddr = inodeGetBlockAddr(root, blockIndex + 1);
-      if (nextAddr == 0) { free(blockBuf); free(root); return -1; }
+      if (nextAddr == 0) { free(blockBuf); inodePut(root); return -1; }
       if (readBlock(d, nextAddr, blockSize, blockBuf) != 0) {
-        free(blockBuf); free(root); return -1;
+        free(blockBuf); inodePut(root); return -1;
       }
       memcpy(((unsigned char*)&ent) + part1, blockBuf, entrySize - part1);
     }
@@ -430,7 +479,7 @@ static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int
     if (strncmp(ent.name, name, MAX_FILENAME_LENGTH) == 0) {
       *outInumber = ent.inodeNumber;
       free(blockBuf);
-      free(root);
+      inodePut(root);
       return 1;
     }
 
@@ -438,7 +487,7 @@ static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int
   }
 
   free(blockBuf);
-  free(root);
+  inodePut(root);
   return 0;
 }
 
@@ -447,7 +496,7 @@ static int rootFindEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int
 static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned int inumber) {
   if (!d || !sb || !name || inumber == 0) return -1;
 
-  Inode *root = inodeLoad(ROOT_INODE, d);
+  Inode *root = inodeGet(ROOT_INODE, d);
   if (!root) return -1;
 
   unsigned int blockSize = sb->blockSize;
@@ -464,7 +513,7 @@ static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned i
   unsigned int written = 0;
 
   unsigned char *blockBuf = (unsigned char*)malloc(blockSize);
-  if (!blockBuf) { free(root); return -1; }
+  if (!blockBuf) { inodePut(root); return -1; }
 
   while (written < total) {
     unsigned int pos = fileSize + written;
@@ -476,13 +525,16 @@ static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned i
 
     while (blockIndex >= blocksNow) {
       unsigned long int newBlockAddr = allocateFreeCluster(d, sb);
-      if (newBlockAddr == 0) { free(blockBuf); free(root); return -1; }
-      if (inodeAddBlock(root, newBlockAddr) != 0) { free(blockBuf); free(root); return -1; }
+      if (newBlockAddr == 0) { free(blockBuf); inodePut(root); return -1; }
+      if (inodeAddBlock(root, newBlockAddr) != 0) {
+        releaseCluster(d, sb, newBlockAddr);
+        free(blockBuf); inodePut(root); return -1;
+      }
       blocksNow++;
     }
 
     unsigned long int blockAddr = inodeGetBlockAddr(root, blockIndex);
-    if (blockAddr == 0) { free(blockBuf); free(root); return -1; }
+    if (blockAddr == 0) { free(blockBuf); inodePut(root); return -1; }
 
     unsigned int remaining = total - written;
     unsigned int chunk = blockSize - offInBlock;
@@ -490,7 +542,7 @@ static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned i
 
     if (offInBlock != 0 || chunk != blockSize) {
       if (readBlock(d, blockAddr, blockSize, blockBuf) != 0) {
-        free(blockBuf); free(root); return -1;
+        free(blockBuf); inodePut(root); return -1;
       }
     } else {
       memset(blockBuf, 0, blockSize);
@@ -499,7 +551,7 @@ static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned i
     memcpy(blockBuf + offInBlock, src + written, chunk);
 
     if (writeBlock(d, blockAddr, blockSize, blockBuf) != 0) {
-      free(blockBuf); free(root); return -1;
+      free(blockBuf); inodePut(root); return -1;
     }
 
     written += chunk;
@@ -508,9 +560,9 @@ static int rootAppendEntry(Disk *d, SuperBlock *sb, const char *name, unsigned i
   free(blockBuf);
 
   inodeSetFileSize(root, fileSize + total);
-  if (inodeSave(root) != 0) { free(root); return -1; }
+  inodeMarkDirty(root);
 
-  free(root);
+  inodePut(root);
   return 0;
 }
 
@@ -545,7 +597,10 @@ int myFSOpen(Disk *d, const char *path) {
     if (inumber == 0) return -1;
 
     Inode *fileInode = inodeCreate(inumber, d);
-    if (!fileInode) return -1;
+    if (!fileInode) {
+      inodeFreeInode(inumber, d);
+      return -1;
+    }
 
     inodeSetFileType(fileInode, FILETYPE_REGULAR);
     inodeSetFileSize(fileInode, 0);
@@ -553,23 +608,32 @@ int myFSOpen(Disk *d, const char *path) {
 
     if (inodeSave(fileInode) < 0) {
       free(fileInode);
+      inodeFreeInode(inumber, d);
       return -1;
     }
     free(fileInode);
 
-    if (rootAppendEntry(d, &sb, name, inumber) != 0) return -1;
+    if (rootAppendEntry(d, &sb, name, inumber) != 0) {
+      inodeFreeInode(inumber, d);
+      return -1;
+    }
   }
 
+  Inode *inode = inodeGet(inumber, d);
+  if (!inode) return -1;
+
   for (int i = 0; i < MAX_FDS; i++) {
     if (!openFiles[i].used) {
       openFiles[i].used = 1;
       openFiles[i].inumber = inumber;
       openFiles[i].cursor = 0;
       openFiles[i].disk = d;
+      openFiles[i].inode = inode;
       return i + 1;
     }
   }
 
+  inodePut(inode);
   return -1;
 }
 
@@ -600,16 +664,13 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
   Disk *d = openFiles[idx].disk;
   if (!d) return -1;
 
-  unsigned int inumber = openFiles[idx].inumber;
-
-  Inode *inode = inodeLoad(inumber, d);
+  Inode *inode = openFiles[idx].inode;
   if (!inode)
     return -1;
 
   SuperBlock sb;
   if (readSuperBlock(d, &sb) != 0)
   {
-    free(inode);
     return -1;
   }
 
@@ -618,7 +679,6 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
 
   if (cursor >= fileSize)
   {
-    free(inode);
     return 0;
   }
 
@@ -631,7 +691,6 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
   unsigned char *blockBuf = (unsigned char *)malloc(blockSize);
   if (!blockBuf)
   {
-    free(inode);
     return -1;
   }
 
@@ -645,14 +704,12 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
     if (blockAddr == 0)
     {
       free(blockBuf);
-      free(inode);
       return -1;
     }
 
     if (readBlock(d, blockAddr, blockSize, blockBuf) != 0)
     {
       free(blockBuf);
-      free(inode);
       return -1;
     }
 
@@ -669,7 +726,6 @@ int myFSRead(int fd, char *buf, unsigned int nbytes)
   
   openFiles[idx].cursor += readBytes;
 
-  free(inode);
   return (int)readBytes;
 }
 
@@ -698,15 +754,12 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
   Disk *d = openFiles[idx].disk;
   if (!d)
     return -1;
-  unsigned int inumber = openFiles[idx].inumber;
-
-  Inode *inode = inodeLoad(inumber, d);
+  Inode *inode = openFiles[idx].inode;
   if (!inode)
     return -1;
 
   SuperBlock sb;
   if (readSuperBlock(d, &sb) != 0) {
-    free(inode);
     return -1;
   }
 
@@ -718,7 +771,6 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
 
   unsigned char *blockBuf = (unsigned char *)malloc(blockSize);
   if (!blockBuf) {
-    free(inode);
     return -1;
   }
 
@@ -733,13 +785,12 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
       unsigned long int newBlockAddr = allocateFreeCluster(d, &sb);
       if (newBlockAddr == 0) {
         free(blockBuf);
-        free(inode);
         return -1;
       }
 
       if (inodeAddBlock(inode, newBlockAddr) != 0) {
+        releaseCluster(d, &sb, newBlockAddr);
         free(blockBuf);
-        free(inode);
         return -1;
       }
 
@@ -749,7 +800,6 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
     unsigned long int blockAddr = inodeGetBlockAddr(inode, blockIndex);
     if (blockAddr == 0) {
       free(blockBuf);
-      free(inode);
       return -1;
     }
 
@@ -761,7 +811,6 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
     if (offInBlock != 0 || chunk != blockSize) {
       if (readBlock(d, blockAddr, blockSize, blockBuf) != 0) {
         free(blockBuf);
-        free(inode);
         return -1;
       }
     } else {
@@ -772,7 +821,6 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
 
     if (writeBlock(d, blockAddr, blockSize, blockBuf) != 0) {
       free(blockBuf);
-      free(inode);
       return -1;
     }
 
@@ -786,14 +834,11 @@ int myFSWrite(int fd, const char *buf, unsigned int nbytes) {
   free(blockBuf);
 
   openFiles[idx].cursor += written;
-  inodeSetFileSize(inode, fileSize);
-
-  if (inodeSave(inode) != 0) {
-    free(inode);
-    return -1;
+  if (fileSize != inodeGetFileSize(inode)) {
+    inodeSetFileSize(inode, fileSize);
+    inodeMarkDirty(inode);
   }
 
-  free(inode);
   return (int)written;
 }
 
@@ -810,12 +855,18 @@ int myFSClose(int fd) {
   if (!openFiles[index].used)
     return -1;
 
+  // Grava o i-node, se alterado, e devolve a referencia obtida na abertura
+  if (inodeWriteBack(openFiles[index].inode) != 0)
+    return -1;
+  inodePut(openFiles[index].inode);
+
   // Zera o cursor
   openFiles[index].cursor = 0;
 
   // Libera o descritor
   openFiles[index].used = 0;
   openFiles[index].inumber = 0;
+  openFiles[index].inode = NULL;
 
   return 0;
 }